@@ -8,7 +8,7 @@ output=./GrappleMap
 
 echo "Creating $output/."
 
-mkdir -p $output/{composer,search,explorer,editor}
+mkdir -p $output/{composer,search,explorer,editor,db}
 mkdir -p $output/res/store
 
 function download
@@ -40,9 +40,10 @@ cp src/editor.html $output/editor/index.html
 cp src/editor.{css,js} $output/editor/
 cp src/libgrapplemap.{data,js,js.mem} $output/
 cp src/libgrapplemap.{data,js,js.mem} $output/editor/
-cp src/libgrapplemap.{data,js,js.mem} $output/composer/
-cp src/libgrapplemap.{data,js,js.mem} $output/explorer/
-	# todo: copying this thrice is stupid but i dunno how to make the relative paths work otherwise
+	# todo: copying this twice is stupid but i dunno how to make the relative paths work otherwise
+cp src/libgrapplemap-db.{js,js.mem} $output/composer/
+cp src/libgrapplemap-db.{js,js.mem} $output/explorer/
+cp GrappleMap.chunks/*.bin $output/db/
 
 #echo "Converting database to javascript."
 #src/grapplemap-dbtojs --output_dir=$output
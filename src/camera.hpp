@@ -80,6 +80,23 @@ inline V2 world2xy(Camera const & camera, V3 v)
 	return xy(cs) / cs.w;
 }
 
+inline void world2xy(Camera const & camera, V3 const * const in, size_t const n, V2 * const out)
+	// The same for n points at once: the matrix is read once, and the loop
+	// has no calls or branches, so that the compiler can vectorize it.
+{
+	M const & m = camera.full();
+
+	for (size_t i = 0; i != n; ++i)
+	{
+		double const
+			x = in[i].x, y = in[i].y, z = in[i].z,
+			w = m[3]*x + m[7]*y + m[11]*z + m[15];
+
+		out[i].x = (m[0]*x + m[4]*y + m[8]*z + m[12]) / w;
+		out[i].y = (m[1]*x + m[5]*y + m[9]*z + m[13]) / w;
+	}
+}
+
 inline V2 world2screen(Camera const & camera, V3 v)
 {
 	auto t = world2xy(camera, v);
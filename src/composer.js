@@ -533,6 +533,8 @@ function on_mirror_button_clicked()
 
 function resetFrames()
 {
+	want_frames(steps.map(function(s) { return s.transition; }));
+
 	if (steps.length == 0)
 	{
 		var p = db.nodes[start_node].position;
@@ -577,7 +579,10 @@ function decode_steps(s)
 
 function random_drill()
 {
-	steps = random_path(64);
+	steps = random_path(64, function(t)
+		{
+			return doubled(t) ? t.frame_count * 2 - 1 : t.frame_count;
+		});
 	start_node = step_from(steps[0]).node;
 
 	resetFrames();
@@ -593,6 +598,12 @@ function random_drill()
 	pick_bullet();
 }
 
+function doubled(t)
+	// whether t is shown with double_frames
+{
+	return t.properties.indexOf("detailed") == -1;
+}
+
 function double_frames(frames)
 {
 	var r = [frames[0]];
@@ -604,16 +615,24 @@ function double_frames(frames)
 	return r;
 }
 
-function emscripten_loaded()
+function on_frames(transitions)
 {
-	loadAndPrepDB();
+	if (steps.some(function(s) { return transitions.indexOf(s.transition) != -1; }))
+		resetFrames();
+}
 
-	db.transitions.forEach(function(t)
+function emscripten_loaded()
+{
+	streamDB(
+		function(t, frames)
 		{
-			if (t.properties.indexOf("detailed") == -1)
-				t.frames = double_frames(t.frames);
-		});
+			return doubled(t) ? double_frames(frames) : frames;
+		},
+		start, on_frames);
+}
 
+function start()
+{
 	var s = window.location.href;
 	var qmark = s.lastIndexOf('?');
 	if (qmark != -1)
@@ -77,12 +77,16 @@ namespace
 
 unique_ptr<Application> app;
 
+optional<QueryEngine> query_engine;
+	// for search.js; the graph does not change on that page
+
 EMSCRIPTEN_BINDINGS(GrappleMap_cursor_canvas)
 {
 	emscripten::function("cursor_canvas_main", +[]
 		{
 			app.reset(new Application);
 			editor_canvas = app.get();
+			query_engine = none;
 			return to_elaborate_jsval(app->editor.getGraph(), true);
 		});
 
@@ -99,6 +103,14 @@ EMSCRIPTEN_BINDINGS(GrappleMap_cursor_canvas)
 			w.reset();
 	});
 
+	emscripten::function("cursor_canvas_query", +[](emscripten::val const & tags, emscripten::val const & substrs)
+	{
+		if (!query_engine) query_engine.emplace(app->editor.getGraph());
+
+		return tojsval((*query_engine)(tag_query_fromjsval(tags),
+			emscripten::vecFromJSArray<std::string>(substrs)));
+	});
+
 	emscripten::function("cursor_canvas_mirror_view", +[]
 	{
 		app->editor.mirror();
@@ -0,0 +1,35 @@
+#include "persistence.hpp"
+
+int main(int const argc, char const * const * const argv)
+{
+	try
+	{
+		bool const chunked = argc == 4 && std::string(argv[1]) == "--chunks";
+
+		if (argc != 3 && !chunked)
+		{
+			std::cerr <<
+				"usage: grapplemap-dbtobin GrappleMap.txt GrappleMap.bin\n"
+				"   or: grapplemap-dbtobin --chunks GrappleMap.txt DIR\n";
+			return 1;
+		}
+
+		GrappleMap::Graph const g = GrappleMap::loadGraph(argv[argc - 2]);
+
+		if (chunked)
+		{
+			GrappleMap::saveChunked(g, argv[3]);
+			return 0;
+		}
+
+		std::ofstream f(argv[2], std::ios::binary);
+		GrappleMap::saveBinary(g, f);
+		f.close();
+		if (!f) GrappleMap::error(std::string("could not write ") + argv[2]);
+	}
+	catch (std::exception const & e)
+	{
+		std::cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
+}
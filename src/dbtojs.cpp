@@ -1,6 +1,15 @@
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+	// see https://www.robertnitsch.de/notes/cpp/cpp11_boost_filesystem_undefined_reference_copy_file
+
 #include "persistence.hpp"
 #include "js_conversions.hpp"
+#include "tasks.hpp"
+#include "md5.hpp"
 #include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
 
 using namespace GrappleMap;
 
@@ -8,6 +17,8 @@ struct Config
 {
 	string db;
 	string output_dir;
+	bool shards;
+	unsigned jobs;
 };
 
 optional<Config> config_from_args(int const argc, char const * const * const argv)
@@ -23,7 +34,13 @@ optional<Config> config_from_args(int const argc, char const * const * const arg
 			"output directory")
 		("db",
 			po::value<string>()->default_value("GrappleMap.txt"),
-			"database file");
+			"database file")
+		("shards",
+			po::value<bool>()->default_value(false),
+			"instead of transitions.js, write index.json plus content-addressed shards")
+		("jobs,j",
+			po::value<unsigned>()->default_value(Executor::default_threads()),
+			"number of threads writing shards");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -33,7 +50,146 @@ optional<Config> config_from_args(int const argc, char const * const * const arg
 
 	return Config
 		{ vm["db"].as<string>()
-		, vm["output_dir"].as<string>() };
+		, vm["output_dir"].as<string>()
+		, vm["shards"].as<bool>()
+		, vm["jobs"].as<unsigned>() };
+}
+
+namespace
+{
+	string frames_bin(vector<Position> const & frames)
+		// Little-endian int16 thousandths, by frame, player, joint, xyz,
+		// for an Int16Array on the client. The database only has
+		// thousandths, so this loses nothing.
+	{
+		string r;
+		r.reserve(frames.size() * joint_count * 2 * 3 * 2);
+
+		foreach (p : frames)
+		foreach (n : playerNums())
+		foreach (j : joints)
+		{
+			V3 const v = p[n][j];
+
+			foreach (c : {v.x, v.y, v.z})
+			{
+				long const q = std::lround(c * 1000);
+				if (q < -32768 || q > 32767) error("coordinate out of range: " + to_string(c));
+				r += char(q & 0xff);
+				r += char((q >> 8) & 0xff);
+			}
+		}
+
+		return r;
+	}
+
+	class ShardWriter
+		// Shards are named after their content, so a shard that already
+		// exists is unchanged and is left alone (keeping its mtime and any
+		// caches in front of it warm).
+	{
+		string const dir;
+		std::atomic<size_t> written{0}, skipped{0};
+
+	public:
+
+		explicit ShardWriter(string d): dir(std::move(d)) {}
+
+		string operator()(string const & subdir, string const & content, string const & ext)
+			// Returns the shard's name, relative to subdir.
+		{
+			string const name = MD5(content).hexdigest().substr(0, 16) + ext;
+			string const path = dir + '/' + subdir + '/' + name;
+
+			if (boost::filesystem::exists(path)) { ++skipped; return name; }
+
+			string const tmp = path + ".tmp";
+				// so that a partially written shard never looks like an unchanged one
+
+			{
+				ofstream f(tmp, std::ios::binary);
+				f << content;
+				if (!f.flush()) error("could not write " + tmp);
+			}
+
+			if (std::rename(tmp.c_str(), path.c_str()) != 0) error("could not rename " + tmp);
+
+			++written;
+			return name;
+		}
+
+		size_t num_written() const { return written; }
+		size_t num_skipped() const { return skipped; }
+	};
+
+	void write_shards(Graph const & graph, string const & dir, unsigned const jobs)
+		// Writes nodes/, transitions/ and frames/, and then index.json, which
+		// lists the shards by id. Shard names change with their content, so
+		// index.json is the only file that needs a short cache lifetime.
+	{
+		foreach (d : {"nodes", "transitions", "frames"})
+			boost::filesystem::create_directories(dir + '/' + d);
+
+		ShardWriter write(dir);
+
+		vector<string> nodes(graph.num_nodes()), transitions(graph.num_sequences()), frames(graph.num_sequences());
+			// each filled by its own task, in place
+
+		{
+			Executor executor(jobs);
+
+			foreach (n : nodenums(graph))
+				executor.spawn([&, n]
+					{
+						std::ostringstream js;
+						tojson(n, graph, js);
+						nodes[n.index] = write("nodes", js.str(), ".json");
+					});
+
+			foreach (s : seqnums(graph))
+				executor.spawn([&, s]
+					{
+						std::ostringstream js;
+						tojson(s, graph, js);
+						transitions[s.index] = write("transitions", js.str(), ".json");
+						frames[s.index] = write("frames", frames_bin(graph[s].positions), ".bin");
+					});
+
+			executor.wait();
+		}
+
+		auto list = [](vector<string> const & v, std::ostream & js)
+			{
+				js << '[';
+				bool first = true;
+				foreach (x : v)
+				{
+					if (first) first = false; else js << ',';
+					js << '"' << x << '"';
+				}
+				js << ']';
+			};
+
+		string const index = dir + "/index.json";
+		string const tmp = index + ".tmp";
+
+		{
+			ofstream js(tmp);
+			js << "{\"version\":1,\"nodes\":";
+			list(nodes, js);
+			js << ",\n\"transitions\":";
+			list(transitions, js);
+			js << ",\n\"frames\":";
+			list(frames, js);
+			js << "}\n";
+			if (!js.flush()) error("could not write " + tmp);
+		}
+
+		if (std::rename(tmp.c_str(), index.c_str()) != 0) error("could not rename " + tmp);
+
+		std::cout << "Wrote " << write.num_written() << " shards, "
+			<< write.num_skipped() << " unchanged.\n";
+	}
 }
 
 int main(int const argc, char const * const * const argv)
@@ -43,6 +199,12 @@ int main(int const argc, char const * const * const argv)
 		optional<Config> const config = config_from_args(argc, argv);
 		if (!config) return 0;
 
+		if (config->shards)
+		{
+			write_shards(GrappleMap::loadGraph(config->db), config->output_dir, config->jobs);
+			return 0;
+		}
+
 		ofstream js(config->output_dir + "/transitions.js");
 
 		js << std::boolalpha;
@@ -1,6 +1,5 @@
-#include "graph_util.hpp"
+#include "differ.hpp"
 #include "persistence.hpp"
-#include <boost/variant.hpp>
 
 namespace GrappleMap
 {
@@ -24,207 +23,6 @@ namespace GrappleMap
 			: g[n].description.front();
 	}
 
-// representation of graph diffs:
-
-	enum class PositionComparison { identical, reoriented, changed };
-	enum class TransComparison { identical, adapted };
-		// adapted means all non-end frames equal, and end frames mapped to same DiffNode
-
-	struct RemovedNode { NodeNum a; };
-	struct AddedNode { NodeNum b; };
-
-	struct RemovedEdge { SeqNum a; };
-	struct AddedEdge { SeqNum b; };
-
-	struct CommonNode
-	{
-		NodeNum a, b;
-		bool same_name, same_desc;
-		PositionComparison position;
-	};
-
-	struct CommonEdge
-	{
-		SeqNum a, b;
-		TransComparison edge;
-	};
-
-	struct DiffGraph
-	{
-		Graph const & ga, & gb;
-
-		using Node = boost::variant<RemovedNode, AddedNode, CommonNode>;
-		using Edge = boost::variant<RemovedEdge, AddedEdge, CommonEdge>;
-
-		map<NodeNum, Node> nodes;
-		map<SeqNum, Edge> edges;
-		map<NodeNum, NodeNum> a_to_c, b_to_c;
-		map<SeqNum, SeqNum> sa_to_c, sb_to_c;
-
-		NodeNum to(SeqNum const s) const
-		{
-			Edge const & e = edges.at(s);
-
-			if (auto const * a = boost::get<RemovedEdge const>(&e))
-				return a_to_c.at(*ga[a->a].to);
-			else if (auto const * b = boost::get<AddedEdge const>(&e))
-				return b_to_c.at(*gb[b->b].to);
-			else if (auto const * common = boost::get<CommonEdge const>(&e))
-				return a_to_c.at(*ga[common->a].to);
-			else abort();
-		}
-
-		NodeNum from(SeqNum const s) const
-		{
-			Edge const & e = edges.at(s);
-
-			if (auto const * a = boost::get<RemovedEdge const>(&e))
-				return a_to_c.at(*ga[a->a].from);
-			else if (auto const * b = boost::get<AddedEdge const>(&e))
-				return b_to_c.at(*gb[b->b].from);
-			else if (auto const * common = boost::get<CommonEdge const>(&e))
-				return a_to_c.at(*ga[common->a].from);
-			else abort();
-		}
-	};
-
-// computing diff graph:
-
-	struct Differ
-	{
-		Differ(Graph const & a, Graph const & b)
-			: ga(a), gb(b)
-		{
-			compare_positions();
-			compare_transitions();
-		}
-
-		Graph const & ga, & gb;
-
-		DiffGraph diff{ga, gb};
-
-		optional<CommonNode> compare_position(NodeNum const a, NodeNum const b) const
-		{
-			CommonNode common{a, b,
-				(ga[a].description.empty() && gb[b].description.empty()) ||
-				(!ga[a].description.empty() && !gb[b].description.empty() &&
-					ga[a].description.front() == gb[b].description.front()),
-				desc(ga[a]) == desc(gb[b]) };
-
-			if (ga[a].position == gb[b].position)
-			{
-				common.position = PositionComparison::identical;
-				return common;
-			}
-
-			if (is_reoriented(ga[a].position, gb[b].position))
-			{
-				common.position = PositionComparison::reoriented;
-				return common;
-			}
-
-			common.position = PositionComparison::changed;
-
-			if (common.same_name && name(ga[a]))
-				return common;
-
-			return {};
-		}
-
-		optional<CommonEdge> compare_edge(SeqNum const a, SeqNum const b)
-		{
-			CommonEdge common{a, b};
-
-			auto const & pa = ga[a].positions;
-			auto const & pb = gb[b].positions;
-
-			if (pa == pb)
-			{
-				common.edge = TransComparison::identical;
-				return common;
-			}
-
-			vector<Position> middleA(pa.begin() + 1, pa.end() - 1);
-			vector<Position> middleB(pb.begin() + 1, pb.end() - 1);
-
-			if (middleA == middleB &&
-				diff.a_to_c[*ga[a].from] == diff.b_to_c[*gb[b].from] &&
-				diff.a_to_c[*ga[a].to] == diff.b_to_c[*gb[b].to])
-			{
-				common.edge = TransComparison::adapted;
-				return common;
-			}
-
-			return {};
-		}
-
-		void compare_positions()
-			// post: all A positions appear in a_to_c, analogous for B.
-		{
-			NodeNum c{0};
-
-			foreach (a : nodenums(ga))
-			{
-				diff.a_to_c[a] = c;
-
-				optional<CommonNode> common;
-
-				foreach (b : nodenums(gb))
-					if (common = compare_position(a, b))
-					{
-						diff.b_to_c[b] = c;
-						break;
-					}
-
-				if (common) diff.nodes[c] = *common;
-				else diff.nodes[c] = RemovedNode{a};
-
-				++c;
-			}
-
-			foreach (b : nodenums(gb))
-				if (!elem(b, diff.b_to_c))
-				{
-					diff.b_to_c[b] = c;
-					diff.nodes[c] = AddedNode{b};
-					++c;
-				}
-		}
-
-		void compare_transitions()
-			// post: all A sequences appear in sa_to_c, analogous for B.
-		{
-			SeqNum c{0};
-
-			foreach (a : seqnums(ga))
-			{
-				diff.sa_to_c[a] = c;
-
-				optional<CommonEdge> common;
-
-				foreach (b : seqnums(gb))
-					if (common = compare_edge(a, b))
-					{
-						diff.sb_to_c[b] = c;
-						break;
-					}
-
-				if (common) diff.edges[c] = *common;
-				else diff.edges[c] = RemovedEdge{a};
-
-				++c;
-			}
-
-			foreach (b : seqnums(gb))
-				if (!elem(b, diff.sb_to_c))
-				{
-					diff.sb_to_c[b] = c;
-					diff.edges[c] = AddedEdge{b};
-					++c;
-				}
-		}
-	};
-
 // describing diff graph as text:
 
 	string describe(NodeNum n, Graph const & g)
@@ -0,0 +1,72 @@
+#include "differ.hpp"
+
+namespace GrappleMap
+{
+	DiffChanges changes(DiffGraph const & diff, unsigned const radius)
+	{
+		Graph const & ga = diff.ga, & gb = diff.gb;
+
+		DiffChanges r;
+		set<NodeNum> dirty_a, dirty_b;
+
+		auto ends = [](Graph const & g, SeqNum const s, set<NodeNum> & out)
+			{
+				out.insert(*g[s].from);
+				out.insert(*g[s].to);
+			};
+
+		foreach (x : diff.nodes)
+			if (auto const * a = boost::get<RemovedNode const>(&x.second))
+				dirty_a.insert(a->a);
+			else if (auto const * b = boost::get<AddedNode const>(&x.second))
+				dirty_b.insert(b->b);
+			else if (auto const * common = boost::get<CommonNode const>(&x.second))
+			{
+				if (common->a != common->b
+					|| common->position != PositionComparison::identical
+					|| ga[common->a].description != gb[common->b].description)
+				{
+					dirty_a.insert(common->a);
+					dirty_b.insert(common->b);
+				}
+			}
+
+		foreach (x : diff.edges)
+			if (auto const * a = boost::get<RemovedEdge const>(&x.second))
+				ends(ga, a->a, dirty_a);
+			else if (auto const * b = boost::get<AddedEdge const>(&x.second))
+			{
+				ends(gb, b->b, dirty_b);
+				r.sequences.insert(b->b);
+			}
+			else if (auto const * common = boost::get<CommonEdge const>(&x.second))
+			{
+				Graph::Edge const & ea = ga[common->a], & eb = gb[common->b];
+
+				if (common->a != common->b
+					|| common->edge != TransComparison::identical
+					|| ea.description != eb.description
+					|| ea.detailed != eb.detailed
+					|| ea.bidirectional != eb.bidirectional)
+				{
+					ends(ga, common->a, dirty_a);
+					ends(gb, common->b, dirty_b);
+					r.sequences.insert(common->b);
+				}
+			}
+
+		// Distances are measured in both graphs, because a removed
+		// transition may have been what brought two nodes close.
+
+		r.nodes = dirty_b;
+		foreach (n : nodes_around(gb, dirty_b, radius)) r.nodes.insert(n);
+
+		foreach (n : nodes_around(ga, dirty_a, radius)) dirty_a.insert(n);
+
+		foreach (a : dirty_a)
+			if (auto const * common = boost::get<CommonNode const>(&diff.nodes.at(diff.a_to_c.at(a))))
+				r.nodes.insert(common->b);
+
+		return r;
+	}
+}
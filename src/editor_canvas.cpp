@@ -6,45 +6,6 @@ namespace GrappleMap
 
 	namespace
 	{
-		double whereBetween(V2 const v, V2 const w, V2 const cursor)
-		{
-			V2 const
-				a = cursor - v,
-				b = w - v;
-
-			return std::max(0., std::min(1., inner_prod(a, b) / norm2(b) / norm2(b)));
-		}
-
-		optional<Reoriented<Location>>
-			determineNextPos(
-				Graph const & graph, PlayerJoint const j,
-				vector<Reoriented<SegmentInSequence>> const & candidates,
-				Camera const & camera, V2 const cursor)
-		{
-			struct Best { Reoriented<Location> loc; double score; };
-
-			optional<Best> best;
-
-			foreach (candidate : candidates)
-			{
-				V2 const
-					v = world2xy(camera, at(from(candidate), j, graph)),
-					w = world2xy(camera, at(to(candidate), j, graph));
-
-				double const howfar = whereBetween(v, w, cursor);
-
-				V2 const ultimate = v + (w - v) * howfar;
-
-				double const score = distanceSquared(ultimate, cursor);
-
-				if (!best || score < best->score)
-					best = Best{{Location{*candidate, howfar}, candidate.reorientation}, score};
-			}
-
-			if (!best) return boost::none;
-			return best->loc;
-		}
-
 		View const
 			external_view
 				{0, 0, 1, 1, none, 60},
@@ -53,14 +14,6 @@ namespace GrappleMap
 			player1_view
 				{0, 0, 1, 1, player1, 120};
 
-		bool operator!=(Dirty const & a, Dirty const & b)
-		{
-			return a.nodes_added != b.nodes_added
-				|| a.nodes_changed != b.nodes_changed
-				|| a.edges_added != b.edges_added
-				|| a.edges_changed != b.edges_changed;
-		}
-
 		using HighlightableLoc = pair<SegmentInSequence, optional<PositionInSequence>>;
 
 		HighlightableLoc highlightable_loc(Location const & loc)
@@ -98,33 +51,11 @@ namespace GrappleMap
 
 		void update_modified(EditorCanvas & app, bool const force = false)
 		{
-			Graph const & g = app.editor.getGraph();
-
-			Dirty d;
-			d.nodes_added.reserve(app.dirty.nodes_added.size() + 5);
-			d.edges_added.reserve(app.dirty.edges_added.size() + 5);
-			d.nodes_changed.reserve(app.dirty.nodes_changed.size() + 5);
-			d.edges_changed.reserve(app.dirty.edges_changed.size() + 5);
-
-			foreach(n : nodenums(g))
-				switch (g[n].modified)
-				{
-					case modified: d.nodes_changed.push_back(n); break;
-					case added: d.nodes_added.push_back(n); break;
-					default: break;
-				}
+			size_t const r = app.editor.getGraph().dirty_revision();
 
-			foreach(s : seqnums(g))
-				switch (g[s].modified)
-				{
-					case modified: d.edges_changed.push_back(s); break;
-					case added: d.edges_added.push_back(s); break;
-					default: break;
-				}
-
-			if (force || app.dirty != d)
+			if (force || r != app.dirty_revision)
 			{
-				app.dirty = move(d);
+				app.dirty_revision = r;
 				EM_ASM({ update_modified(); });
 			}
 		}
@@ -426,10 +357,7 @@ namespace GrappleMap
 				glfwGetMouseButton(w.window, GLFW_MOUSE_BUTTON_3) != GLFW_PRESS &&
 				!w.chosen_joint)
 			{
-				Position const pos = w.editor.current_position();
-				w.closest_joint = *minimal(
-					playerJoints.begin(), playerJoints.end(),
-					[&](PlayerJoint j) { return norm2(world2xy(w.camera, pos[j]) - newcur); });
+				w.closest_joint = w.picker.closest_joint(w.camera, w.editor.current_position(), newcur);
 			}
 		}
 
@@ -440,13 +368,10 @@ namespace GrappleMap
 			if (!entered) w.cursor = boost::none;
 		}
 
-		size_t do_render(EditorCanvas const & w, vector<BasicVertex> & out)
+		void do_render(EditorCanvas & w, WindowVertices & out)
 		{
-			int width, height;
-			glfwGetFramebufferSize(w.window, &width, &height);
-
 			PerPlayerJoint<optional<V3>> colors;
-			vector<Viable> viables;
+			optional<Reoriented<Location>> location;
 			OrientedPath selection;
 
 			auto const special_joint = w.chosen_joint ? *w.chosen_joint : w.closest_joint;
@@ -460,30 +385,82 @@ namespace GrappleMap
 
 				colors[special_joint] = yellow;
 
-				viables = determineViables(w.editor.getGraph(),
-					from(segment(w.editor.getLocation())),
-					special_joint, &w.camera);
-
+				location = w.editor.getLocation();
 				selection = w.editor.getSelection();
 			}
 
-			return renderWindow({*w.view}, viables, w.editor.getGraph(), w.displayPos(), w.camera, special_joint,
-				colors, 0, 0, width, height, selection, w.editor.getLocation()->segment, w.style, w.playerDrawer, []{}, out);
+			renderWindow(*w.view, w.editor.getGraph(), w.displayPos(), w.camera, special_joint,
+				colors, location, selection, w.style, w.playerDrawer, w.viable_cache, out);
+		}
+
+		void point_vertex_attributes(EditorCanvas const & w, GLuint const buffer)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+			glVertexAttribPointer(w.vpos_location, 3, GL_FLOAT, GL_FALSE,
+				sizeof(float) * 10, (void*) 0);
+
+			glVertexAttribPointer(w.norm_location, 3, GL_FLOAT, GL_FALSE,
+				sizeof(float) * 10, (void*) (sizeof(float) * 3));
+
+			glVertexAttribPointer(w.vcol_location, 4, GL_FLOAT, GL_FALSE,
+				sizeof(float) * 10, (void*) (sizeof(float) * 6));
+		}
+
+		void draw(VertexBuffers<BasicVertex, 4>::Region const & r)
+		{
+			if (r.count != 0) glDrawArrays(GL_TRIANGLES, r.first, r.count);
+		}
+
+		enum Shape { plain_vertices, sphere_instances, pillar_instances }; // see triangle.vertexshader
+
+		void draw_instances(EditorCanvas const & w, Shape const shape, MeshRange const mesh,
+			VertexBuffers<ShapeInstance, 3>::Region const & r)
+		{
+			if (r.count == 0) return;
+
+			point_vertex_attributes(w, w.mesh_buffer);
+
+			glBindBuffer(GL_ARRAY_BUFFER, w.instance_buffers.name());
+
+			auto const attrib = [&](GLint const loc, GLint const size, size_t const offset)
+				{
+					glEnableVertexAttribArray(loc);
+					glVertexAttribDivisor(loc, 1);
+					glVertexAttribPointer(loc, size, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance),
+						(void*) (r.first * sizeof(ShapeInstance) + offset));
+				};
+
+			attrib(w.ifrom_location, 3, offsetof(ShapeInstance, from));
+			attrib(w.ito_location, 3, offsetof(ShapeInstance, to));
+			attrib(w.iradii_location, 2, offsetof(ShapeInstance, from_radius));
+			attrib(w.icolor_location, 4, offsetof(ShapeInstance, color));
+
+			glUniform1i(w.shape_location, shape);
+			glDrawArraysInstanced(GL_TRIANGLES, mesh.first, mesh.count, r.count);
+			glUniform1i(w.shape_location, plain_vertices);
+
+			foreach (loc : {w.ifrom_location, w.ito_location, w.iradii_location, w.icolor_location})
+				glDisableVertexAttribArray(loc);
 		}
 
 		void do_frame() { editor_canvas->frame(); }
 	}
 
-	size_t EditorCanvas::makeVertices()
+	void EditorCanvas::makeVertices()
 	{
-		vertices.clear();
+		do_render(*this, vertices);
 
-		size_t r = do_render(*this, vertices);
+		PlayerInstances const & players = vertices.players.get();
+		unsigned const players_version = vertices.players.version();
 
-		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BasicVertex), vertices.data(), GL_DYNAMIC_DRAW);
+		vertex_buffers.upload(
+			{{ &vertices.grid.get(), &players.triangles, &vertices.selection.get(), &vertices.viables.get() }},
+			{{ vertices.grid.version(), players_version, vertices.selection.version(), vertices.viables.version() }});
 
-		return r;
+		instance_buffers.upload(
+			{{ &players.fine_spheres, &players.coarse_spheres, &players.pillars }},
+			{{ players_version, players_version, players_version }});
 	}
 
 	Position EditorCanvas::displayPos() const
@@ -512,14 +489,14 @@ namespace GrappleMap
 			& sel = editor.getSelection().empty() ? tempSel : editor.getSelection();
 				// ugh
 
-		candidates = closeCandidates(
+		candidates = viable_cache.candidates(
 			editor.getGraph(), segment(editor.getLocation()),
-			&camera, editor.lockedToSelection() ? &sel : nullptr);
+			camera, editor.lockedToSelection() ? &sel : nullptr);
 
 		auto const special_joint = chosen_joint ? *chosen_joint : closest_joint;
 
 		if (cursor && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
-			if (auto best_next_loc = determineNextPos(
+			if (auto best_next_loc = picker.next_location(
 					editor.getGraph(), special_joint,
 					candidates[special_joint], camera, *cursor))
 			{
@@ -543,7 +520,7 @@ namespace GrappleMap
 			camera.setOffset(c);
 		}
 
-		size_t non_hud_elems = makeVertices();
+		makeVertices();
 
 		auto make_first_person_matrix = [&]
 			{
@@ -567,14 +544,23 @@ namespace GrappleMap
 		glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
 
 		glUniform1f(LightEnabledLoc, 1.0);
-		glDrawArrays(GL_TRIANGLES, 0, non_hud_elems);
 
-		if (vertices.size() != non_hud_elems)
+		point_vertex_attributes(*this, vertex_buffers.name());
+		draw(vertex_buffers[0]); // grid
+		draw(vertex_buffers[1]); // torsos and feet
+
+		draw_instances(*this, sphere_instances, fine_sphere_mesh, instance_buffers[0]);
+		draw_instances(*this, sphere_instances, coarse_sphere_mesh, instance_buffers[1]);
+		draw_instances(*this, pillar_instances, pillar_mesh, instance_buffers[2]);
+
+		if (vertex_buffers[2].count != 0 || vertex_buffers[3].count != 0)
 		{
 			glDisable(GL_DEPTH_TEST);
 
 			glUniform1f(LightEnabledLoc, 0.0);
-			glDrawArrays(GL_TRIANGLES, non_hud_elems, vertices.size() - non_hud_elems);
+			point_vertex_attributes(*this, vertex_buffers.name());
+			draw(vertex_buffers[2]); // selection
+			draw(vertex_buffers[3]); // viables
 
 			glEnable(GL_DEPTH_TEST);
 		}
@@ -633,9 +619,27 @@ namespace GrappleMap
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-		glGenBuffers(1, &vertex_buffer);
+		foreach (b : vertex_buffers.buffers) glGenBuffers(1, &b.name);
+		foreach (b : instance_buffers.buffers) glGenBuffers(1, &b.name);
 
-		makeVertices();
+		{
+			vector<BasicVertex> meshes = playerDrawer.sphereDrawer.unitMesh(true);
+			fine_sphere_mesh = {0, GLsizei(meshes.size())};
+
+			auto append = [&](vector<BasicVertex> const & v)
+				{
+					MeshRange const r{GLint(meshes.size()), GLsizei(v.size())};
+					meshes.insert(meshes.end(), v.begin(), v.end());
+					return r;
+				};
+
+			coarse_sphere_mesh = append(playerDrawer.sphereDrawer.unitMesh(false));
+			pillar_mesh = append(playerDrawer.unitPillar());
+
+			glGenBuffers(1, &mesh_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh_buffer);
+			glBufferData(GL_ARRAY_BUFFER, meshes.size() * sizeof(BasicVertex), meshes.data(), GL_STATIC_DRAW);
+		}
 
 		std::string const
 			vertex_shader_src = readFile("triangle.vertexshader"),
@@ -662,23 +666,21 @@ namespace GrappleMap
 		vpos_location = glGetAttribLocation(program, "vertexPosition_modelspace");
 		norm_location = glGetAttribLocation(program, "vertexNormal_modelspace");
 		vcol_location = glGetAttribLocation(program, "vertexColor");
+		ifrom_location = glGetAttribLocation(program, "instanceFrom");
+		ito_location = glGetAttribLocation(program, "instanceTo");
+		iradii_location = glGetAttribLocation(program, "instanceRadii");
+		icolor_location = glGetAttribLocation(program, "instanceColor");
 
 		mvp_location = glGetUniformLocation(program, "MVP");
 		ViewMatrixID = glGetUniformLocation(program, "V");
 		ModelMatrixID = glGetUniformLocation(program, "M");
 		LightEnabledLoc = glGetUniformLocation(program, "LightEnabled");
+		shape_location = glGetUniformLocation(program, "Shape");
 
 		glEnableVertexAttribArray(vpos_location);
-		glVertexAttribPointer(vpos_location, 3, GL_FLOAT, GL_FALSE,
-			sizeof(float) * 10, (void*) 0);
-
 		glEnableVertexAttribArray(norm_location);
-		glVertexAttribPointer(norm_location, 3, GL_FLOAT, GL_FALSE,
-			sizeof(float) * 10, (void*) (sizeof(float) * 3));
-
 		glEnableVertexAttribArray(vcol_location);
-		glVertexAttribPointer(vcol_location, 4, GL_FLOAT, GL_FALSE,
-			sizeof(float) * 10, (void*) (sizeof(float) * 6));
+			// pointed at a buffer before each draw (see point_vertex_attributes)
 
 		glUseProgram(program);
 
@@ -775,10 +777,10 @@ namespace GrappleMap
 			vector<emscripten::val>
 				nodes_added, nodes_changed, edges_added, edges_changed;
 
-			foreach(n : editor_canvas->dirty.nodes_added) nodes_added.push_back(tojsval(n, g));
-			foreach(n : editor_canvas->dirty.nodes_changed) nodes_changed.push_back(tojsval(n, g));
-			foreach(s : editor_canvas->dirty.edges_added) edges_added.push_back(tojsval(s, g));
-			foreach(s : editor_canvas->dirty.edges_changed) edges_changed.push_back(tojsval(s, g));
+			foreach(n : g.nodes_added()) nodes_added.push_back(tojsval(n, g));
+			foreach(n : g.nodes_changed()) nodes_changed.push_back(tojsval(n, g));
+			foreach(s : g.edges_added()) edges_added.push_back(tojsval(s, g));
+			foreach(s : g.edges_changed()) edges_changed.push_back(tojsval(s, g));
 
 			auto d = emscripten::val::object();
 			d.set("nodes_added", tojsval(nodes_added));
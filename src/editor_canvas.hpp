@@ -9,6 +9,7 @@
 #include "math.hpp"
 #include "positions.hpp"
 #include "viables.hpp"
+#include "picking.hpp"
 #include "rendering.hpp"
 #include "graph_util.hpp"
 #include "metadata.hpp"
@@ -27,12 +28,76 @@
 
 namespace GrappleMap
 {
-	struct Dirty
+	template<typename T, size_t N>
+	struct VertexBuffers
+		// Two GL buffers used on alternate frames, so that an upload never
+		// has to wait for the previous frame's draw calls. Each buffer keeps
+		// N arrays of T in regions of their own, with room to grow, and an
+		// array is only uploaded if it changed since that buffer last
+		// received it.
 	{
-		vector<NodeNum> nodes_added, nodes_changed;
-		vector<SeqNum> edges_added, edges_changed;
+		struct Region
+		{
+			size_t first = 0, capacity = 0, count = 0; // in elements
+			optional<unsigned> version;
+		};
+
+		struct Buffer
+		{
+			GLuint name;
+			std::array<Region, N> regions;
+		};
+
+		std::array<Buffer, 2> buffers;
+		unsigned current = 0;
+
+		void upload(std::array<vector<T> const *, N> const & arrays, std::array<unsigned, N> const & versions)
+			// Switches to the other buffer and brings it up to date. Leaves it bound.
+		{
+			current = 1 - current;
+			Buffer & b = buffers[current];
+
+			glBindBuffer(GL_ARRAY_BUFFER, b.name);
+
+			bool fits = true;
+			for (size_t i = 0; i != N; ++i)
+				if (arrays[i]->size() > b.regions[i].capacity) fits = false;
+
+			if (!fits)
+			{
+				size_t first = 0;
+
+				for (size_t i = 0; i != N; ++i)
+				{
+					Region & r = b.regions[i];
+					r.first = first;
+					r.capacity = std::max(size_t(256), arrays[i]->size() * 3 / 2);
+					r.version = none;
+					first += r.capacity;
+				}
+
+				glBufferData(GL_ARRAY_BUFFER, first * sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+			}
+
+			for (size_t i = 0; i != N; ++i)
+			{
+				Region & r = b.regions[i];
+				if (r.version == versions[i]) continue;
+
+				glBufferSubData(GL_ARRAY_BUFFER,
+					r.first * sizeof(T), arrays[i]->size() * sizeof(T), arrays[i]->data());
+
+				r.count = arrays[i]->size();
+				r.version = versions[i];
+			}
+		}
+
+		GLuint name() const { return buffers[current].name; }
+		Region const & operator[](size_t i) const { return buffers[current].regions[i]; }
 	};
 
+	struct MeshRange { GLint first; GLsizei count; };
+
 	struct EditorCanvas
 	{
 		EditorCanvas();
@@ -42,10 +107,15 @@ namespace GrappleMap
 		GLuint ViewMatrixID;
 		GLuint ModelMatrixID;
 		GLuint LightEnabledLoc;
-		GLuint vertex_buffer, vertex_shader, fragment_shader;
+		GLuint vertex_shader, fragment_shader;
 		GLint vpos_location, vcol_location, norm_location;
 
-		vector<BasicVertex> vertices;
+		WindowVertices vertices;
+		VertexBuffers<BasicVertex, 4> vertex_buffers; // grid, player triangles, selection, viables
+		VertexBuffers<ShapeInstance, 3> instance_buffers; // fine spheres, coarse spheres, pillars
+		GLuint mesh_buffer; // the unit meshes the instances stretch
+		MeshRange fine_sphere_mesh, coarse_sphere_mesh, pillar_mesh;
+		GLint shape_location, ifrom_location, ito_location, iradii_location, icolor_location;
 		double lastTime{};
 
 		PlayerJoint closest_joint = {{0}, LeftAnkle};
@@ -53,12 +123,14 @@ namespace GrappleMap
 		bool edit_mode = false;
 		optional<Position> clipboard;
 		Camera camera;
-		Editor editor{loadGraph("GrappleMap.txt")};
+		Editor editor{loadBinaryGraph("GrappleMap.bin")};
 		double jiggle = 0;
 		optional<V2> cursor;
 		Style style;
 		PlayerDrawer playerDrawer;
 		PerPlayerJoint<vector<Reoriented<SegmentInSequence>>> candidates;
+		ViableCache viable_cache;
+		Picker picker;
 		int videoOffset = 0;
 		GLFWwindow * window;
 		string joints_to_edit = "single_joint";
@@ -66,7 +138,8 @@ namespace GrappleMap
 		bool confine_interpolation = false;
 		bool confine_local_edits = true;
 		bool transform_rotate = false;
-		Dirty dirty;
+		size_t dirty_revision = 0;
+			// the graph revision the page last heard about
 		bool ignore_keyboard = false;
 		View const * view;
 
@@ -75,7 +148,7 @@ namespace GrappleMap
 		virtual Position displayPos() const;
 
 		void frame();
-		size_t makeVertices();
+		void makeVertices();
 
 		virtual ~EditorCanvas() {}
 	};
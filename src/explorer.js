@@ -180,8 +180,11 @@ function updateCamera()
 
 function emscripten_loaded()
 {
-	loadAndPrepDB();
+	streamDB(null, start);
+}
 
+function start()
+{
 	var s = window.location.href;
 	var qmark = s.lastIndexOf('?');
 	if (qmark != -1)
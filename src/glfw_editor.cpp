@@ -4,8 +4,10 @@
 #include "math.hpp"
 #include "positions.hpp"
 #include "viables.hpp"
+#include "picking.hpp"
 #include "rendering.hpp"
 #include "graph_util.hpp"
+#include "triple_buffer.hpp"
 #include <GLFW/glfw3.h>
 #include <boost/program_options.hpp>
 #include <cmath>
@@ -15,57 +17,21 @@
 #include <algorithm>
 #include <iterator>
 #include <stack>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
 
 using namespace GrappleMap;
 
-namespace
-{
-	double whereBetween(V2 const v, V2 const w, V2 const cursor)
-	{
-		V2 const
-			a = cursor - v,
-			b = w - v;
-
-		return std::max(0., std::min(1., inner_prod(a, b) / norm2(b) / norm2(b)));
-	}
-
-	optional<Reoriented<Location>>
-		determineNextPos(
-			Graph const & graph, PlayerJoint const j,
-			vector<Reoriented<SegmentInSequence>> const & candidates,
-			Camera const & camera, V2 const cursor)
-	{
-		struct Best { Reoriented<Location> loc; double score; };
-
-		optional<Best> best;
-
-		foreach (candidate : candidates)
-		{
-			V2 const
-				v = world2xy(camera, at(from(candidate), j, graph)),
-				w = world2xy(camera, at(to(candidate), j, graph));
-
-			double const howfar = whereBetween(v, w, cursor);
-
-			V2 const ultimate = v + (w - v) * howfar;
-
-			double const score = distanceSquared(ultimate, cursor);
-
-			if (!best || score < best->score)
-				best = Best{Location{*candidate, howfar}, candidate.reorientation, score};
-		}
-
-		if (!best) return boost::none;
-		return best->loc;
-	}
-}
-
 struct Application
 {
 	explicit Application(boost::program_options::variables_map const & opts, GLFWwindow * w)
 		: dbFile(opts["db"].as<string>())
 		, editor(loadGraph(dbFile))
 		, window(w)
+		, frame_stats(opts["frame_stats"].as<bool>())
 	{
 		go_to_desc(opts["start"].as<string>(), editor);
 	}
@@ -80,10 +46,11 @@ struct Application
 	Editor editor;
 	double jiggle = 0;
 	double last_cursor_x = 0, last_cursor_y = 0;
-	Style style;
-	PlayerDrawer playerDrawer;
 	PerPlayerJoint<vector<Reoriented<SegmentInSequence>>> candidates;
+	ViableCache viable_cache;
+	Picker picker;
 	GLFWwindow * const window;
+	bool const frame_stats;
 };
 
 void print_status(Application const & w)
@@ -347,7 +314,8 @@ boost::optional<po::variables_map> readArgs(int const argc, char const * const *
 		("help,h", "show this help")
 		("start", po::value<string>()->default_value("last-trans"), "see START below")
 		("db", po::value<string>()->default_value("GrappleMap.txt"), "database file")
-		("video", po::value<string>(), "video MRL (man 1 xine)");
+		("video", po::value<string>(), "video MRL (man 1 xine)")
+		("frame_stats", po::value<bool>()->default_value(false), "periodically print frame time statistics");
 
 	po::positional_options_description posopts;
 	posopts.add("start", -1);
@@ -421,47 +389,150 @@ void update_camera(Application & w)
 	}
 }
 
-void do_render(Application const & w)
+struct Scene
+	// Everything the render thread needs for one frame.
+{
+	Position position;
+	Camera camera;
+	vector<View> const * views = nullptr;
+	Overlay overlay;
+		// the selection and viables, so that the graph itself is
+		// only ever touched by the model thread
+	PerPlayerJoint<optional<V3>> colors;
+	PlayerJoint special_joint;
+	int width = 0, height = 0;
+	double made = 0; // glfwGetTime()
+};
+
+class FrameTimes
+	// Durations recorded on one thread and summarized on another.
+{
+	std::mutex m;
+	vector<double> samples;
+
+public:
+
+	void add(double const seconds)
+	{
+		std::lock_guard<std::mutex> lock(m);
+		samples.push_back(seconds);
+	}
+
+	string summary()
+		// Resets.
+	{
+		vector<double> v;
+		{
+			std::lock_guard<std::mutex> lock(m);
+			v.swap(samples);
+		}
+
+		if (v.empty()) return "-";
+
+		std::sort(v.begin(), v.end());
+
+		std::ostringstream s;
+		s << std::fixed << std::setprecision(1)
+			<< v.size() << "x, avg " << std::accumulate(v.begin(), v.end(), 0.) / v.size() * 1000
+			<< "ms, p95 " << v[v.size() * 95 / 100] * 1000
+			<< "ms, max " << v.back() * 1000 << "ms";
+		return s.str();
+	}
+};
+
+struct FrameStats
+{
+	FrameTimes model, render, latency;
+		// latency: from the model having made a scene until it was on screen
+};
+
+void make_scene(Application & w, Scene & scene)
 {
 	int width, height;
 	glfwGetFramebufferSize(w.window, &width, &height);
 
-	PerPlayerJoint<optional<V3>> colors;
-	vector<Viable> viables;
-	OrientedPath selection;
-
 	auto const special_joint = w.chosen_joint ? *w.chosen_joint : w.closest_joint;
 
+	scene.position = w.editor.current_position();
+	scene.camera = w.camera;
+	scene.views = &(w.split_view ? split_view : single_view);
+	scene.special_joint = special_joint;
+	scene.width = width;
+	scene.height = height;
+	scene.colors = {};
+	scene.overlay.strips.clear();
+	scene.overlay.marks.clear();
+
 	if (!w.editor.playingBack())
 	{
-		if (w.edit_mode) foreach (j : playerJoints) colors[j] = white;
+		if (w.edit_mode) foreach (j : playerJoints) scene.colors[j] = white;
 		else foreach (j : playerJoints)
 			if (!w.candidates[j].empty())
-				colors[j] = V3(white) * 0.4 + playerDefs[j.player].color * 0.6;
+				scene.colors[j] = V3(white) * 0.4 + playerDefs[j.player].color * 0.6;
 
-		colors[special_joint] = yellow;
+		scene.colors[special_joint] = yellow;
 
-		viables = determineViables(w.editor.getGraph(),
-			from(segment(w.editor.getLocation())),
-			special_joint, &w.camera);
+		Graph const & graph = w.editor.getGraph();
+		OrientedPath const & selection = w.editor.getSelection();
 
-		selection = w.editor.getSelection();
+		addSelection(scene.overlay, graph, selection, special_joint, boost::none);
+		addViables(scene.overlay, graph,
+			w.viable_cache.viables(graph, from(segment(w.editor.getLocation())), special_joint, w.camera),
+			selection, boost::none);
 	}
 
-	auto & views = w.split_view ? split_view : single_view;
+	scene.made = glfwGetTime();
+}
 
+void do_render(Scene const & s, Style const & style, PlayerDrawer const & playerDrawer)
+{
 	glEnable(GL_DEPTH);
 	glEnable(GL_DEPTH_TEST);
 
-	renderWindow(views, viables, w.editor.getGraph(), w.editor.current_position(), w.camera, special_joint,
-		colors, 0, 0, width, height, selection, w.style, w.playerDrawer,
-		[&]{ });
+	renderWindow(*s.views, s.overlay, s.position, s.camera, s.special_joint,
+		s.colors, 0, 0, s.width, s.height, style, playerDrawer);
+}
+
+void render_loop(GLFWwindow * const window, TripleBuffer<Scene> & scenes,
+	std::atomic<bool> const & done, FrameStats & stats)
+{
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(1);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	Style const style;
+	PlayerDrawer playerDrawer;
+
+	while (!done)
+	{
+		if (!scenes.lockNewValue())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		Scene const & scene = scenes.getLockedValue();
+
+		double const start = glfwGetTime();
+
+		do_render(scene, style, playerDrawer);
+		glfwSwapBuffers(window);
+
+		double const now = glfwGetTime();
+		stats.render.add(now - start);
+		stats.latency.add(now - scene.made);
+	}
+
+	glfwMakeContextCurrent(nullptr);
 }
 
 double lastTime{};
 unique_ptr<Application> app;
 
 void frame()
+	// Input and model work. Rendering happens on the render thread.
 {
 	glfwPollEvents();
 
@@ -498,14 +569,14 @@ void frame()
 		& sel = w.editor.getSelection().empty() ? tempSel : w.editor.getSelection();
 			// ugh
 
-	w.candidates = closeCandidates(
+	w.candidates = w.viable_cache.candidates(
 		w.editor.getGraph(), segment(w.editor.getLocation()),
-		&w.camera, w.editor.lockedToSelection() ? &sel : nullptr);
+		w.camera, w.editor.lockedToSelection() ? &sel : nullptr);
 
 	auto const special_joint = w.chosen_joint ? *w.chosen_joint : w.closest_joint;
 
 	if (cursor && glfwGetMouseButton(w.window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
-		if (auto best_next_pos = determineNextPos(
+		if (auto best_next_pos = w.picker.next_location(
 				w.editor.getGraph(), special_joint,
 				w.candidates[special_joint], w.camera, *cursor))
 		{
@@ -517,10 +588,7 @@ void frame()
 		do_edit(w, *cursor);
 	else if (cursor && !w.chosen_joint)
 	{
-		Position const pos = w.editor.current_position();
-		w.closest_joint = *minimal(
-			playerJoints.begin(), playerJoints.end(),
-			[&](PlayerJoint j) { return norm2(world2xy(w.camera, pos[j]) - *cursor); });
+		w.closest_joint = w.picker.closest_joint(w.camera, w.editor.current_position(), *cursor);
 	}
 
 	if (!w.edit_mode && !w.chosen_joint && !w.editor.playingBack())
@@ -530,10 +598,6 @@ void frame()
 		w.camera.setOffset(c);
 	}
 
-	do_render(w);
-
-	glfwSwapBuffers(w.window);
-
 	double const now = glfwGetTime();
 	w.editor.frame(now - lastTime);
 	lastTime = now;
@@ -555,8 +619,6 @@ int main(int const argc, char const * const * const argv)
 		GLFWwindow * const window = glfwCreateWindow(640, 480, "GrappleMap", nullptr, nullptr);
 		if (!window) error("could not create window");
 
-		glfwMakeContextCurrent(window);
-
 		app.reset(new Application(*vm, window));
 
 		glfwSetWindowUserPointer(window, app.get());
@@ -565,18 +627,67 @@ int main(int const argc, char const * const * const argv)
 		glfwSetScrollCallback(window, scroll_callback);
 		glfwSetCursorPosCallback(window, cursor_pos_callback);
 
-		glfwSwapInterval(1);
-
 		lastTime = glfwGetTime();
 
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		// This thread handles input and edits the graph, and hands
+		// immutable scenes to the render thread, which owns the GL context.
+		// Slow edits therefore no longer hold up drawing, and drawing
+		// no longer holds up input.
+
+		TripleBuffer<Scene> scenes;
+		std::atomic<bool> done{false};
+		FrameStats stats;
+		string render_error;
+
+		std::thread renderer([&]
+			{
+				try { render_loop(window, scenes, done, stats); }
+				catch (std::exception const & e)
+				{
+					render_error = e.what();
+					glfwSetWindowShouldClose(window, 1);
+				}
+			});
+
+		auto const tick = std::chrono::microseconds(1000000 / 60);
+			// The model used to be paced by buffer swaps. Camera
+			// movement is per frame, so keep it at the usual 60Hz.
+
+		auto next_frame = std::chrono::steady_clock::now();
+		double last_stats = glfwGetTime();
 
 		while (!glfwWindowShouldClose(window))
 		{
+			double const start = glfwGetTime();
+
 			frame();
+			make_scene(*app, scenes.startNewValue());
+			scenes.postNewValue();
+
+			double const now = glfwGetTime();
+			stats.model.add(now - start);
+
+			if (app->frame_stats && now - last_stats > 2)
+			{
+				std::cout
+					<< "\nmodel:   " << stats.model.summary()
+					<< "\nrender:  " << stats.render.summary()
+					<< "\nlatency: " << stats.latency.summary() << '\n';
+
+				last_stats = now;
+			}
+
+			next_frame += tick;
+			auto const t = std::chrono::steady_clock::now();
+			if (next_frame < t) next_frame = t; // don't try to catch up after a slow frame
+			else std::this_thread::sleep_until(next_frame);
 		}
 
+		done = true;
+		renderer.join();
+
+		if (!render_error.empty()) error(render_error);
+
 		std::cout << '\n';
 	}
 	catch (std::exception const & e)
@@ -435,7 +435,9 @@ function random_node()
 	return randInt(db.nodes.length);
 }
 
-function random_path(min_frames)
+function random_path(min_frames, frame_count)
+	// frame_count(t), if given, is how many frames transition t is shown
+	// with, for pages whose prep_frames (see prepDB) changes that.
 {
 	var steps = [];
 	var node = random_node();
@@ -458,7 +460,8 @@ function random_path(min_frames)
 		if (steps.length == 0 || steps[steps.length - 1].transition != step.transition)
 		{
 			steps.push(step);
-			frames += db.transitions[step.transition].frames.length;
+			var t = db.transitions[step.transition];
+			frames += frame_count ? frame_count(t) : t.frame_count;
 
 			node = step_to(step).node;
 			continue;
@@ -552,14 +555,42 @@ function grow(start, pred)
 	return yes;
 }
 
-function position_v3(pos)
+function position_from_floats(a, offset)
+	// layout as written by web_db_loader.cpp: players, joints, xyz
 {
-	pos.forEach(function(player){
-		for (var i = 0; i != player.length; ++i)
-		{
-			player[i] = v3(player[i].x, player[i].y, player[i].z);
-		}
-	});
+	var pos = [];
+	for (var p = 0; p != 2; ++p)
+	{
+		var player = [];
+		for (var j = 0; j != joints.length; ++j, offset += 3)
+			player.push(v3(a[offset], a[offset + 1], a[offset + 2]));
+		pos.push(player);
+	}
+	return pos;
+}
+
+function positions_from_floats(a)
+{
+	var r = [];
+	for (var o = 0; o < a.length; o += 2 * joints.length * 3)
+		r.push(position_from_floats(a, o));
+	return r;
+}
+
+function lazy_property(obj, name, make, ready)
+	// obj[name] becomes make() when first read while ready() (if given)
+	// holds, unless assigned before that. Reads before that just give make().
+{
+	function settle(v)
+	{
+		Object.defineProperty(obj, name, {value: v, writable: true, enumerable: true, configurable: true});
+		return v;
+	}
+
+	Object.defineProperty(obj, name,
+		{ get: function() { var v = make(); return (!ready || ready()) ? settle(v) : v; }
+		, set: settle
+		, enumerable: true, configurable: true });
 }
 
 function reo_v3(reo)
@@ -567,14 +598,20 @@ function reo_v3(reo)
 	reo.offset = v3(reo.offset.x, reo.offset.y, reo.offset.z);
 }
 
-function loadAndPrepDB()
+function prepDB(prep_frames, frames_ready)
+	// Frames and node positions are only fetched and converted when first
+	// used, so pages only pay for what they show. If given, prep_frames(t, frames)
+	// may transform a transition's frames at that point.
 {
-	db = Module.loadDB();
-
 	db.transitions.forEach(function(t)
 		{
 			t.desc_lines = t.description[0].split('\\n');
-			t.frames.forEach(position_v3);
+			lazy_property(t, 'frames', function()
+				{
+					var frames = positions_from_floats(Module.framesOf(t.id));
+					return prep_frames ? prep_frames(t, frames) : frames;
+				},
+				frames_ready && function() { return frames_ready(t); });
 			reo_v3(t.to.reo);
 			reo_v3(t.from.reo);
 		});
@@ -586,9 +623,140 @@ function loadAndPrepDB()
 			else
 				n.desc_lines = n.description[0].split('\\n');
 
-			position_v3(n.position);
+			lazy_property(n, 'position', function()
+				{ return position_from_floats(Module.positionOf(n.id), 0); });
 
 			n.x = Math.random() * 1000;
 			n.y = Math.random() * 1000;
 		});
 }
+
+function loadAndPrepDB(prep_frames)
+	// from the database preloaded with the wasm module
+{
+	db = Module.loadDB();
+	prepDB(prep_frames);
+}
+
+// Streaming the database in chunks (see saveChunked in persistence.hpp):
+
+var db_chunks_url = '../db/';
+var chunks_wanted = []; // most urgent first
+var chunk_state = []; // by chunk: undefined, 'loading', 'loaded' or 'failed'
+var frames_loaded = []; // by transition
+
+var fetch_attempts = 5;
+var fetch_timeout = 30000; // ms, per attempt
+
+function show_load_error(text)
+	// in a bar at the bottom of the page, since the page may otherwise
+	// just look empty or stuck
+{
+	console.error(text);
+
+	var bar = document.getElementById('load_error');
+	if (!bar)
+	{
+		bar = document.createElement('div');
+		bar.id = 'load_error';
+		bar.style.cssText = 'position:fixed;left:0;right:0;bottom:0;z-index:100;padding:4px 8px;background:#a00;color:white';
+		document.body.appendChild(bar);
+	}
+	bar.textContent = text;
+}
+
+function fetch_binary(url, f, fail)
+	// Retries with exponential backoff, except on client errors like 404,
+	// and calls fail(message) if that does not help.
+{
+	var attempt = 0;
+
+	function go()
+	{
+		var xhr = new XMLHttpRequest();
+		xhr.open('GET', url, true);
+		xhr.responseType = 'arraybuffer';
+		xhr.timeout = fetch_timeout;
+
+		function failed(why, retry)
+		{
+			if (retry && ++attempt < fetch_attempts)
+				setTimeout(go, 1000 * Math.pow(2, attempt - 1));
+			else fail(url + ": " + why);
+		}
+
+		xhr.onload = function()
+			{
+				if (xhr.status == 200) f(new Uint8Array(xhr.response));
+				else failed(xhr.status + " " + xhr.statusText, xhr.status < 400 || xhr.status >= 500);
+			};
+		xhr.onerror = function() { failed("network error", true); };
+		xhr.ontimeout = function() { failed("timed out", true); };
+		xhr.send();
+	}
+
+	go();
+}
+
+function streamDB(prep_frames, on_head, on_frames)
+	// Calls on_head() as soon as the metadata and node positions are in,
+	// and then fetches transitions' frames in the background, calling
+	// on_frames(transition_ids) as they arrive. Until then, a transition's
+	// frames are just its end positions.
+{
+	fetch_binary(db_chunks_url + 'head.bin', function(bytes)
+		{
+			db = Module.loadDBHead(bytes);
+			prepDB(prep_frames, function(t) { return frames_loaded[t.id]; });
+
+			for (var c = 0; c != db.chunk_count; ++c) chunks_wanted.push(c);
+
+			on_head();
+			fetch_next_chunk(on_frames);
+		},
+		function(why)
+		{
+			show_load_error("Could not load the database (" + why + "). Try reloading the page.");
+		});
+}
+
+function want_frames(transitions)
+	// fetch the frames of these transitions before any others
+{
+	if (!db.chunk_count) return; // not streaming
+
+	transitions.forEach(function(t)
+		{
+			var c = db.transitions[t].chunk;
+			if (chunk_state[c] === undefined) chunks_wanted.unshift(c);
+		});
+}
+
+function fetch_next_chunk(on_frames)
+{
+	while (chunks_wanted.length != 0 && chunk_state[chunks_wanted[0]] !== undefined)
+		chunks_wanted.shift();
+
+	if (chunks_wanted.length == 0) return;
+
+	var c = chunks_wanted.shift();
+	chunk_state[c] = 'loading';
+
+	fetch_binary(db_chunks_url + 'frames' + c + '.bin', function(bytes)
+		{
+			chunk_state[c] = 'loaded';
+
+			var ids = Module.addChunk(bytes);
+			ids.forEach(function(t) { frames_loaded[t] = true; });
+			if (on_frames) on_frames(ids);
+
+			fetch_next_chunk(on_frames);
+		},
+		function(why)
+		{
+			chunk_state[c] = 'failed'; // so that want_frames does not ask for it again
+			show_load_error("Some transitions could not be loaded (" + why + "), "
+				+ "so they only show their end positions.");
+			fetch_next_chunk(on_frames);
+		});
+}
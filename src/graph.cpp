@@ -109,14 +109,44 @@ void Graph::replace(PositionInSequence const pis, Position p, NodeModifyPolicy c
 
 void Graph::mark_dirty(NodeNum const n)
 {
-	if (*data[n][&Node::modified] == original)
-		data[n][&Node::modified] = modified;
+	if (data->nodes[n.index].modified == original)
+		set_modified(n, modified);
 }
 
 void Graph::mark_dirty(SeqNum const seq)
 {
-	if (*data[seq][&Edge::modified] == original)
-		data[seq][&Edge::modified] = modified;
+	if (data->edges[seq.index].modified == original)
+		set_modified(seq, modified);
+}
+
+void Graph::set_modified(NodeNum const n, Modified const m)
+{
+	Modified const old = data->nodes[n.index].modified;
+	if (old == m) return;
+
+	data[n][&Node::modified] = m;
+
+	if (old == added) data[&Data::nodes_added].erase_key(n);
+	if (old == modified) data[&Data::nodes_changed].erase_key(n);
+	if (m == added) data[&Data::nodes_added].insert_key(n);
+	if (m == modified) data[&Data::nodes_changed].insert_key(n);
+
+	++dirty_revision_;
+}
+
+void Graph::set_modified(SeqNum const s, Modified const m)
+{
+	Modified const old = data->edges[s.index].modified;
+	if (old == m) return;
+
+	data[s][&Edge::modified] = m;
+
+	if (old == added) data[&Data::edges_added].erase_key(s);
+	if (old == modified) data[&Data::edges_changed].erase_key(s);
+	if (m == added) data[&Data::edges_added].insert_key(s);
+	if (m == modified) data[&Data::edges_changed].insert_key(s);
+
+	++dirty_revision_;
 }
 
 void Graph::split_segment(Location const loc)
@@ -145,13 +175,14 @@ void Graph::set(optional<SeqNum> const num, optional<Sequence> seq)
 
 		if (num)
 		{
-			e.modified = modified;
+			e.modified = data->edges[num->index].modified;
 			data[*num] = move(e);
+			set_modified(*num, modified);
 		}
 		else
 		{
-			e.modified = added;
 			data[&Data::edges].push_back(move(e));
+			set_modified(SeqNum{data->edges.size() - 1}, added);
 		}
 
 		compute_in_out(*from);
@@ -161,6 +192,21 @@ void Graph::set(optional<SeqNum> const num, optional<Sequence> seq)
 	{
 		data[&Data::edges].erase(num->index);
 
+		auto shift = [&](std::set<SeqNum> Data::* m)
+			{
+				// later edges moved down by one
+
+				auto && x = data[m];
+				std::set<SeqNum> v;
+				foreach (s : *x)
+					if (s != *num) v.insert(s.index < num->index ? s : SeqNum{s.index - 1});
+				if (v != *x) x = v;
+			};
+
+		shift(&Data::edges_added);
+		shift(&Data::edges_changed);
+		++dirty_revision_;
+
 		foreach (n : nodenums(*this))
 			compute_in_out(n);
 	}
@@ -347,6 +393,24 @@ Graph::Graph(vector<NamedPosition> pp, vector<Sequence> ss, vector<pair<NodeNum,
 	data.forget_past();
 }
 
+Graph::Graph(vector<NamedPosition> pp, vector<Edge> ee)
+{
+	foreach (p : pp) data[&Data::nodes].push_back(Node(move(p)));
+
+	foreach (e : ee)
+	{
+		if (e.from->index >= num_nodes() || e.to->index >= num_nodes())
+			error("transition endpoint out of range");
+
+		data[&Data::edges].push_back(move(e));
+	}
+
+	foreach (n : nodenums(*this))
+		compute_in_out(n);
+
+	data.forget_past();
+}
+
 vector<string> lines(string const & s)
 {
 	vector<string> v;
@@ -359,8 +423,8 @@ void Graph::set_description(NodeNum n, string const & d)
 	auto x = data[n][&Node::description];
 	bool const was_empty = x->empty();
 	x = lines(d);
-	if (data[n][&Node::modified] != added)
-		data[n][&Node::modified] = (was_empty ? added : modified);
+	if (data->nodes[n.index].modified != added)
+		set_modified(n, was_empty ? added : modified);
 }
 
 void Graph::set_description(SeqNum s, string const & d)
@@ -79,11 +79,16 @@ private:
 		vector<Node> nodes;
 		vector<Edge> edges;
 
+		std::set<NodeNum> nodes_added, nodes_changed;
+		std::set<SeqNum> edges_added, edges_changed;
+			// mirror the 'modified' members, so that they are rewound with them
+
 		friend Node & follow(Data & d, NodeNum n) { return d.nodes[n.index]; }
 		friend Edge & follow(Data & d, SeqNum s) { return d.edges[s.index]; }
 	};
 
 	Rewindable<Data> data;
+	size_t dirty_revision_ = 0;
 
 	optional<ReorientedNode> is_reoriented_node(Position const &) const;
 
@@ -98,10 +103,16 @@ private:
 	void mark_dirty(NodeNum);
 	void mark_dirty(SeqNum);
 
+	void set_modified(NodeNum, Modified);
+	void set_modified(SeqNum, Modified);
+
 public:
 
 	Graph(vector<NamedPosition>, vector<Sequence>);
 	Graph(vector<NamedPosition>, vector<Sequence>, vector<pair<NodeNum,NodeNum>> index);
+	Graph(vector<NamedPosition>, vector<Edge>);
+		// for edges whose endpoints have already been resolved (as in a binary database),
+		// so only checks that the node numbers are in range
 
 	Graph & operator=(Graph &&) = default;
 	Graph(Graph &&) = default;
@@ -122,6 +133,20 @@ public:
 	uint16_t num_sequences() const { return data->edges.size(); }
 	uint16_t num_nodes() const { return data->nodes.size(); }
 
+	std::set<NodeNum> const & nodes_added() const { return data->nodes_added; }
+	std::set<NodeNum> const & nodes_changed() const { return data->nodes_changed; }
+	std::set<SeqNum> const & edges_added() const { return data->edges_added; }
+	std::set<SeqNum> const & edges_changed() const { return data->edges_changed; }
+		// by their 'modified' member, maintained as they change
+
+	size_t dirty_revision() const { return dirty_revision_; }
+		// Increases whenever the sets above may have changed,
+		// so that a viewer can skip looking at them otherwise.
+
+	size_t revision() const { return data.revision(); }
+		// Increases with every change to the graph, including by rewind(),
+		// for caches of things derived from it.
+
 	// mutation
 
 	void replace(PositionInSequence, Position, NodeModifyPolicy);
@@ -136,7 +161,7 @@ public:
 		// both means replace
 
 	void rewind_point() { data.rewind_point(); }
-	void rewind() { data.rewind(); }
+	void rewind() { data.rewind(); ++dirty_revision_; }
 
 	void set_description(NodeNum, string const &);
 	void set_description(SeqNum, string const &);
@@ -0,0 +1,258 @@
+#include "resolve.hpp"
+#include "images.hpp"
+#include "persistence.hpp"
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+using namespace GrappleMap;
+
+namespace
+{
+	struct Config
+	{
+		string what, db;
+		unsigned width, height, runs;
+	};
+
+	optional<Config> config_from_args(int const argc, char const * const * const argv)
+	{
+		namespace po = boost::program_options;
+
+		po::options_description desc("options");
+		desc.add_options()
+			("help,h",
+				"show this help")
+			("what",
+				po::value<string>()->default_value("resolve"),
+				"resolve, setup or blur")
+			("db",
+				po::value<string>()->default_value("GrappleMap.txt"),
+				"database file, for setup")
+			("width",
+				po::value<unsigned>()->default_value(640),
+				"final image width")
+			("height",
+				po::value<unsigned>()->default_value(480),
+				"final image height")
+			("runs",
+				po::value<unsigned>()->default_value(200),
+				"number of images per measurement");
+
+		po::positional_options_description posopts;
+		posopts.add("what", 1);
+
+		po::variables_map vm;
+		po::store(po::command_line_parser(argc, argv).options(desc).positional(posopts).run(), vm);
+		po::notify(vm);
+
+		if (vm.count("help"))
+		{
+			cout << desc <<
+				"\nresolve: Times resolve (see resolve.hpp) at factors 2 and 4, against the "
+				"column-major loop that images.cpp used before it.\n"
+				"setup: Times ImageMaker::png with OSMesa, with and without reusing each "
+				"thread's RenderResources (context, font, meshes and grid lists).\n"
+				"blur: Times ImageMaker::blurred_png, a motion-blurred still of a whole "
+				"transition, for the first runs transitions.\n";
+
+			return none;
+		}
+
+		return Config
+			{ vm["what"].as<string>()
+			, vm["db"].as<string>()
+			, vm["width"].as<unsigned>()
+			, vm["height"].as<unsigned>()
+			, vm["runs"].as<unsigned>() };
+	}
+
+	void column_major_resolve(
+		uint8_t const * const in, unsigned const width, unsigned const height, unsigned const factor,
+		uint8_t * const out)
+		// What write_png did before resolve, generalized to any factor:
+		// a pixel at a time, columns outer, with the channels swapped and
+		// the rows flipped (which it left to separate passes).
+	{
+		size_t const in_row = size_t(width) * factor * 3;
+		unsigned const area = factor * factor;
+
+		for (unsigned x = 0; x != width; ++x)
+		for (unsigned y = 0; y != height; ++y)
+		{
+			unsigned c[3] = {0, 0, 0};
+
+			for (unsigned dy = 0; dy != factor; ++dy)
+			for (unsigned dx = 0; dx != factor; ++dx)
+			{
+				uint8_t const * const p = in + (y * factor + dy) * in_row + (x * factor + dx) * 3;
+				c[0] += p[2];
+				c[1] += p[1];
+				c[2] += p[0];
+			}
+
+			uint8_t * const o = out + (size_t(height - 1 - y) * width + x) * 3;
+			o[0] = c[0] / area;
+			o[1] = c[1] / area;
+			o[2] = c[2] / area;
+		}
+	}
+
+	template<typename F>
+	double ms_per_run(unsigned const runs, F f)
+	{
+		auto const t0 = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i != runs; ++i) f();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / runs;
+	}
+
+	void bench_resolve(Config const & c, unsigned const factor)
+	{
+		vector<uint8_t> in(size_t(c.width) * factor * c.height * factor * 3);
+		std::mt19937 rng(factor);
+		foreach (b : in) b = rng();
+
+		vector<uint8_t> old_out(size_t(c.width) * c.height * 3), new_out(old_out.size());
+
+		double const
+			old_ms = ms_per_run(c.runs, [&]{ column_major_resolve(in.data(), c.width, c.height, factor, old_out.data()); }),
+			new_ms = ms_per_run(c.runs, [&]{ resolve(in.data(), c.width, c.height, factor, true, true, new_out.data()); });
+
+		if (old_out != new_out) error("resolve and the column-major loop disagree");
+
+		cout << "factor " << factor << ", "
+			<< c.width * factor << 'x' << c.height * factor << " to " << c.width << 'x' << c.height << ": "
+			<< std::fixed << std::setprecision(3)
+			<< "column-major " << old_ms << " ms, resolve " << new_ms << " ms ("
+			<< std::setprecision(1) << old_ms / new_ms << "x)\n";
+	}
+
+	void check_average(Config const & c)
+		// Averaging copies of one frame, however weighted, must give that frame back.
+	{
+		vector<uint8_t> frame(size_t(c.width) * c.height * 3);
+		std::mt19937 rng(0);
+		foreach (b : frame) b = rng();
+
+		vector<uint32_t> sums(frame.size());
+		uint32_t total_weight = 0;
+
+		for (uint16_t const weight : {1, 255, 257, 3, 100, 1})
+		{
+			accumulate(frame.data(), frame.size(), weight, sums.data());
+			total_weight += weight;
+		}
+
+		vector<uint8_t> out(frame.size());
+		average(sums.data(), sums.size(), total_weight, out.data());
+
+		if (out != frame) error("average of identical frames differs from the frame");
+	}
+
+	void bench_setup(Config const & c)
+	{
+		Graph const graph = loadGraph(c.db);
+
+		if (c.runs > graph.num_nodes()) error("more runs than there are positions");
+
+		auto measure = [&](bool const reuse)
+			{
+				// Each measurement gets a store of its own, so that no image is
+				// found to exist already. The positions differ per image for the same reason.
+
+				string const dir = (boost::filesystem::temp_directory_path()
+					/ boost::filesystem::unique_path("grapplemap-imagebench-%%%%%%%%")).string();
+
+				boost::filesystem::create_directories(dir + "/store");
+
+				double ms;
+
+				{
+					ImageMaker mkimg(graph, dir);
+					mkimg.reuse_render_resources = reuse;
+
+					ImageView const view{false, Heading::N, {}};
+					unsigned i = 0;
+
+					ms = ms_per_run(c.runs, [&]
+						{
+							NodeNum const n{uint16_t(i % graph.num_nodes())};
+							mkimg.png(graph[n].position, 1, view, c.width, c.height,
+								ImageMaker::WhiteBg, "bench" + to_string(i++));
+						});
+				}
+
+				boost::filesystem::remove_all(dir);
+				return ms;
+			};
+
+		double const
+			fresh = measure(false),
+			reused = measure(true);
+
+		cout << "png, " << c.width << 'x' << c.height << ", " << c.runs << " images: "
+			<< std::fixed << std::setprecision(3)
+			<< "fresh resources " << fresh << " ms/image, reused " << reused << " ms/image "
+			<< "(setup " << fresh - reused << " ms/image)\n";
+	}
+
+	void bench_blur(Config const & c)
+	{
+		Graph const graph = loadGraph(c.db);
+
+		if (c.runs > graph.num_sequences()) error("more runs than there are transitions");
+
+		string const dir = (boost::filesystem::temp_directory_path()
+			/ boost::filesystem::unique_path("grapplemap-imagebench-%%%%%%%%")).string();
+
+		boost::filesystem::create_directories(dir + "/store");
+
+		size_t frames = 0;
+		double ms;
+
+		{
+			ImageMaker mkimg(graph, dir);
+			uint16_t i = 0;
+
+			ms = ms_per_run(c.runs, [&]
+				{
+					vector<Position> const & v = graph[SeqNum{i}].positions;
+					frames += v.size();
+					mkimg.blurred_png(v, Heading::N, c.width, c.height,
+						ImageMaker::WhiteBg, dir + "/blur" + to_string(i++) + ".png");
+				});
+		}
+
+		boost::filesystem::remove_all(dir);
+
+		cout << "blurred png, " << c.width << 'x' << c.height << ", " << c.runs << " transitions: "
+			<< std::fixed << std::setprecision(3)
+			<< ms << " ms/image, " << std::setprecision(1) << double(frames) / c.runs << " frames/image\n";
+	}
+}
+
+int main(int const argc, char const * const * const argv)
+{
+	try
+	{
+		optional<Config> const config = config_from_args(argc, argv);
+		if (!config) return 0;
+
+		if (config->what == "resolve")
+		{
+			check_average(*config);
+			bench_resolve(*config, 2);
+			bench_resolve(*config, 4);
+		}
+		else if (config->what == "setup") bench_setup(*config);
+		else if (config->what == "blur") bench_blur(*config);
+		else error("unknown benchmark: " + config->what);
+	}
+	catch (std::exception const & e)
+	{
+		std::cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
+}
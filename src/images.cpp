@@ -2,22 +2,15 @@
 #include "images.hpp"
 #include "camera.hpp"
 #include "rendering.hpp"
+#include "resolve.hpp"
+#include "raycast.hpp"
+#include "svg.hpp"
 #include <boost/program_options.hpp>
 #include <unistd.h>
-
-namespace GrappleMap
-{
-	inline std::size_t hash_value(V3 const v) // todo: put elsewhere
-	{
-		size_t seed = 0;
-		boost::hash_combine(seed, v.x);
-		boost::hash_combine(seed, v.y);
-		boost::hash_combine(seed, v.z);
-		return seed;
-	}
-}
-
-#include <boost/functional/hash.hpp>
+#include <signal.h>
+#include <cstdio>
+#include <atomic>
+#include <limits>
 
 #ifndef int_p_NULL // ffs
 	#define int_p_NULL (int*)NULL // https://github.com/ignf/gilviewer/issues/8
@@ -29,8 +22,6 @@ namespace GrappleMap
 
 namespace GrappleMap {
 
-auto hash_value(Position const & p) { return boost::hash_value(p.values); }
-
 namespace
 {
 	vector<double> smoothen_v(vector<double> const & v)
@@ -50,253 +41,473 @@ namespace
 
 		return r;
 	}
-}
 
-void ImageMaker::png(
-	Position pos,
-	Camera const & camera,
-	unsigned const width, unsigned const height,
-	string const path, V3 const bg_color,
-	vector<View> const & view,
-	unsigned const grid_size, unsigned const grid_line_width)
-{
-	vector<boost::gil::rgb8_pixel_t> buf(width*2 * height*2);
+	class Mp4Encoder
+		// Feeds frames to ffmpeg, either as raw rgb24 over a pipe, or (if
+		// png_frames) via numbered PNG files in a directory of its own in
+		// /tmp, which is removed again when the encoder finishes.
+	{
+		string const output_file, frame_dir;
+		unsigned const width, height;
+		bool const png_frames;
+		size_t frames = 0;
+		FILE * pipe = nullptr;
 
-	if (!OSMesaMakeCurrent(ctx.context, buf.data(), GL_UNSIGNED_BYTE, width*2, height*2))
-		error("OSMesaMakeCurrent");
+		static std::atomic<unsigned> next_id;
 
-	Style style;
-	style.grid_size = grid_size;
-	style.grid_line_width = grid_line_width;
-	style.grid_color = bg_color * .8;
-	style.background_color = bg_color;
+		string frame_file(string const & number) const
+		{
+			return frame_dir + "/frame" + number + ".png";
+		}
 
-	PlayerDrawer playerDrawer;
+		void remove_frames()
+		{
+			boost::system::error_code e;
+			boost::filesystem::remove_all(frame_dir, e);
+		}
+
+		string command(string const & input) const
+		{
+			return "ffmpeg -threads 1 -y -loglevel error " + input
+				+ " -frames:v " + to_string(frames)
+				+ " -c:v libx264 -pix_fmt yuv420p -movflags +faststart '" + output_file + "'";
+		}
 
-	renderWindow(
-		view,
-		{}, // no viables
-		graph, pos, camera,
-		none, // no highlighted joint
-		{}, // default colors
-		0, 0, width*2, height*2,
-		{},
-		style, playerDrawer);
+	public:
 
-	glFlush();
-	glFinish();
+		Mp4Encoder(string const & out, unsigned const w, unsigned const h, bool const png)
+			: output_file(out)
+			, frame_dir("/tmp/grapplemap-frames-" + to_string(getpid()) + '-' + to_string(next_id++))
+			, width(w), height(h), png_frames(png)
+		{}
+
+		Mp4Encoder(Mp4Encoder const &) = delete;
+		Mp4Encoder & operator=(Mp4Encoder const &) = delete;
+
+		~Mp4Encoder()
+		{
+			if (pipe) pclose(pipe);
+			if (png_frames) remove_frames();
+		}
 
-	foreach (p : buf) std::swap(p[0], p[2]);
+		void add(boost::gil::rgb8_pixel_t const * const frame)
+			// frame must be width*height pixels, top row first
+		{
+			if (png_frames)
+			{
+				if (frames == 0) boost::filesystem::create_directory(frame_dir);
 
-	vector<boost::gil::rgb8_pixel_t> buf2(width * height);
+				std::ostringstream oss;
+				oss << std::setfill('0') << std::setw(3) << frames;
 
-	auto xy = [&](unsigned x, unsigned y){ return buf[y*width*2+x]; };
+				boost::gil::png_write_view(frame_file(oss.str()),
+					boost::gil::interleaved_view(width, height, frame, width*3));
+			}
+			else
+			{
+				if (!pipe)
+				{
+					string const c = command(
+						"-f rawvideo -pix_fmt rgb24 -s " + to_string(width) + 'x' + to_string(height)
+						+ " -framerate 25 -i -");
+					pipe = popen(c.c_str(), "w");
+					if (!pipe) error("could not run: " + c);
+				}
 
-	for (unsigned x = 0; x != width; ++x)
-	for (unsigned y = 0; y != height; ++y)
+				if (fwrite(frame, 3, width * height, pipe) != width * height)
+				{
+					pclose(pipe);
+					pipe = nullptr;
+					error("ffmpeg stopped accepting frames for " + output_file);
+				}
+			}
+
+			++frames;
+		}
+
+		void finish()
+		{
+			if (png_frames)
+			{
+				string const c = command("-i '" + frame_file("%03d") + "'");
+				int const status = std::system(c.c_str());
+				remove_frames();
+				if (status != 0) error("command failed: " + c);
+			}
+			else if (pipe)
+			{
+				int const status = pclose(pipe);
+				pipe = nullptr;
+				if (status != 0)
+					error("ffmpeg failed (status " + to_string(status) + ") for " + output_file);
+			}
+		}
+	};
+
+	std::atomic<unsigned> Mp4Encoder::next_id{0};
+
+	void resolve(vector<boost::gil::rgb8_pixel_t> const & in, unsigned const width, unsigned const height, boost::gil::rgb8_pixel_t * const out)
+		// in: 2*width by 2*height, as rendered by OSMesa
 	{
-		auto const & a = xy(x*2,  y*2  );
-		auto const & b = xy(x*2+1,y*2  );
-		auto const & c = xy(x*2,  y*2+1);
-		auto const & d = xy(x*2+1,y*2+1);
-
-		buf2[y*width+x][0] = (a[0] + b[0] + c[0] + d[0]) / 4;
-		buf2[y*width+x][1] = (a[1] + b[1] + c[1] + d[1]) / 4;
-		buf2[y*width+x][2] = (a[2] + b[2] + c[2] + d[2]) / 4;
+		GrappleMap::resolve(&in.data()[0][0], width, height, 2, true, true, &out[0][0]);
 	}
-		// todo: clean up
 
-	try
+	void write_png(boost::gil::rgb8_pixel_t const * const frame, unsigned const width, unsigned const height, string const & path)
+		// frame: width*height pixels, top row first
 	{
-		boost::gil::png_write_view(path,
-			boost::gil::flipped_up_down_view(boost::gil::interleaved_view(width, height, buf2.data(), width*3)));
+		try
+		{
+			boost::gil::png_write_view(path,
+				boost::gil::interleaved_view(width, height, frame, width*3));
+		}
+		catch (std::ios_base::failure const &)
+		{
+			error("could not write to " + path);
+		}
 	}
-	catch (std::ios_base::failure const &)
+
+	void write_png(vector<boost::gil::rgb8_pixel_t> const & buf, unsigned const width, unsigned const height, string const & path)
+		// buf: 2*width by 2*height, as rendered by OSMesa
 	{
-		error("could not write to " + path);
+		vector<boost::gil::rgb8_pixel_t> buf2(width * height);
+
+		resolve(buf, width, height, buf2.data());
+
+		write_png(buf2.data(), width, height, path);
 	}
-}
 
-constexpr size_t columns = 10;
+	std::mutex font_mutex; // FreeType faces may not be created or destroyed concurrently
 
-void ImageMaker::make_mp4(
-	string const filename,
-	string const linkname,
-	size_t const delay,
-	unsigned const width, unsigned const height,
-	V3 const bg_color,
-	View const & view,
-	function<vector<pair<Position, Camera>>()> make_pcs)
-{
-	store(filename, linkname, [&]
+	class RenderResources
+		// Everything that is costly to set up and can be reused by all images
+		// rendered on one thread (and hence in one OSMesa context): the
+		// context itself, the font, sphere meshes, pillar angles and grid lists.
+	{
+		OSMesaContextPtr context{OSMesaCreateContextExt(OSMESA_RGB, 16, 0, 16, nullptr)};
+		GridLists grid_lists;
+		unique_ptr<Style> style;
+
+		struct Tessellation
 		{
-			auto pcs = make_pcs();
+			Position position;
+			vector<BasicVertex> vertices; // empty if unused
+		};
 
-			assert(!pcs.empty());
-			if (no_anim) pcs.resize(1);
+		array<Tessellation, 2> tessellations; // most recently used first; enough for a frame and its mirror image
 
-			size_t const
-				n = pcs.size(),
-				rows = n / columns + 1,
-				aawidth = width * 2,
-				aaheight = height * 2,
-				fullwidth = columns * aawidth,
-				fullheight = rows * aaheight;
+		vector<BasicVertex> const & players(Position const & p)
+			// Rotations and the different views of one animation render
+			// the same positions many times, so they are only tessellated once.
+		{
+			auto matches = [&](Tessellation const & t){ return !t.vertices.empty() && t.position == p; };
 
-			vector<boost::gil::rgb8_pixel_t> buf(fullwidth * fullheight);
+			if (!matches(tessellations[0]))
+			{
+				std::swap(tessellations[0], tessellations[1]);
 
-			if (!OSMesaMakeCurrent(ctx.context, buf.data(), GL_UNSIGNED_BYTE, fullwidth, fullheight))
-				error("OSMesaMakeCurrent");
+				if (!matches(tessellations[0]))
+				{
+					tessellations[0].position = p;
+					tessellations[0].vertices.clear();
+					playerDrawer.drawPlayers(p, {}, none, tessellations[0].vertices);
+				}
+			}
 
-			Style style;
-			style.grid_size = 2;
-			style.grid_line_width = 2;
-			style.grid_color = bg_color * .8;
-			style.background_color = bg_color;
+			return tessellations[0].vertices;
+		}
 
-			PlayerDrawer playerDrawer;
+	public:
 
-			for (size_t i = 0; i != n; ++i)
-			{
-				size_t const
-					row = i / columns,
-					column = i % columns;
-
-				renderBasic(
-					view,
-					pcs[i].first, pcs[i].second,
-					{}, // default colors
-					column * aawidth, row * aaheight, aawidth, aaheight,
-					style, playerDrawer);
-			}
+		PlayerDrawer const playerDrawer;
+
+		RenderResources()
+		{
+			if (!context.context) error("OSMesaCreateContextExt failed");
 
-			glFlush();
-			glFinish();
+			std::lock_guard<std::mutex> lock(font_mutex);
+			style.reset(new Style);
+			style->grid_lists = &grid_lists;
+		}
 
-			foreach (p : buf) std::swap(p[0], p[2]);
+		~RenderResources()
+		{
+			std::lock_guard<std::mutex> lock(font_mutex);
+			style.reset();
+		}
 
-			video_generators.add_job(VideoGenerationJob
-				{ res_dir + "/store/" + filename
-				, n, width, height
-				, move(buf) });
-		});
-}
+		Style const & begin(
+			vector<boost::gil::rgb8_pixel_t> & buf, unsigned const width, unsigned const height,
+			V3 const bg_color, unsigned const grid_size = 2, unsigned const grid_line_width = 2)
+			// Makes the context current, rendering into buf, and returns the style to use.
+		{
+			if (!OSMesaMakeCurrent(context.context, buf.data(), GL_UNSIGNED_BYTE, width, height))
+				error("OSMesaMakeCurrent");
 
+			style->grid_size = grid_size;
+			style->grid_line_width = grid_line_width;
+			style->grid_color = bg_color * .8;
+			style->background_color = bg_color;
 
-void process(VideoGenerationJob const & job, size_t const threadid)
-{
-	vector<boost::gil::rgb8_pixel_t> buf2(job.width * job.height);
+			return *style;
+		}
 
-	size_t const
-		aawidth = job.width * 2,
-		aaheight = job.height * 2;
+		void render(View const & view, Position const & pos, Camera const & camera,
+			unsigned const width, unsigned const height, Style const & style)
+		{
+			if (view.first_person)
+				renderBasic(view, pos, camera, {}, 0, 0, width, height, style, playerDrawer);
+			else
+				renderBasic(view, pos, players(pos), camera, 0, 0, width, height, style);
+		}
+	};
 
-	for (size_t i = 0; i != job.num_frames; ++i)
+	Camera heading_camera(double const ymax, double const angle)
 	{
-		size_t const
-			row = i / columns,
-			column = i % columns;
+		Camera camera;
+		camera.hardSetOffset({0, ymax - 0.57, 0});
+		camera.zoom(0.55);
+		camera.rotateHorizontal(angle);
+		camera.rotateVertical((ymax - 0.6)/2);
+		return camera;
+	}
 
-		std::ostringstream oss;
-		oss << "/tmp/t" << threadid << "frame" << std::setfill('0') << std::setw(3) << i << ".png";
-		string const tmpfile = oss.str();
+	vector<double> smooth_ymaxes(vector<Position> const & frames)
+	{
+		vector<double> ymaxes;
+		foreach (pos : frames) ymaxes.push_back(ymax(pos));
+		for (int i = 0; i != 10; ++i)
+			ymaxes = smoothen_v(ymaxes);
+		return ymaxes;
+	}
 
-		auto xy = [&](unsigned x, unsigned y)
-			{
-				return job.tiled_frames[(row * aaheight + y) * (columns * aawidth) + (column * aawidth + x)];
-			};
+	void write_file(string const & path, string const & content)
+	{
+		std::ofstream f(path);
+		f << content;
+		f.close();
+		if (!f) error("could not write to " + path);
+	}
+
+	SvgStyle svg_style(V3 const bg_color)
+		// Matches what OSMesa renders at twice the size, then halves.
+	{
+		SvgStyle s;
+		s.background_color = bg_color;
+		s.grid_color = bg_color * .8;
+		return s;
+	}
+
+	RenderResources & render_resources()
+	{
+		thread_local RenderResources r;
+		return r;
+	}
+
+	double screen_motion(
+		pair<Position, Camera> const & a, pair<Position, Camera> const & b,
+		vector<View> const & views, unsigned const width, unsigned const height)
+		// Largest distance in pixels that a joint moves between a and b.
+	{
+		double r = 0;
 
-		for (unsigned x = 0; x != job.width; ++x)
-		for (unsigned y = 0; y != job.height; ++y)
+		foreach (v : views)
 		{
-			auto const & a = xy(x*2,  y*2  );
-			auto const & b = xy(x*2+1,y*2  );
-			auto const & c = xy(x*2,  y*2+1);
-			auto const & d = xy(x*2+1,y*2+1);
-
-			buf2[y*job.width+x][0] = (a[0] + b[0] + c[0] + d[0]) / 4;
-			buf2[y*job.width+x][1] = (a[1] + b[1] + c[1] + d[1]) / 4;
-			buf2[y*job.width+x][2] = (a[2] + b[2] + c[2] + d[2]) / 4;
+			if (v.first_person) return std::numeric_limits<double>::infinity();
+				// the camera follows a head, so everything may move
+
+			double const w = width * v.w, h = height * v.h;
+
+			Camera ca = a.second, cb = b.second;
+			ca.setViewportSize(v.fov, w, h);
+			cb.setViewportSize(v.fov, w, h);
+
+			foreach (j : playerJoints)
+			{
+				V2 const d = world2xy(ca, a.first[j]) - world2xy(cb, b.first[j]);
+				r = std::max(r, norm2(V2{d.x * w / 2, d.y * h / 2}));
+			}
 		}
 
-		boost::gil::png_write_view(tmpfile,
-			boost::gil::flipped_up_down_view(boost::gil::interleaved_view(job.width, job.height, buf2.data(), job.width*3)));
+		return r;
 	}
 
-	string command = "ffmpeg -threads 1 -y -loglevel panic -i '/tmp/t" + to_string(threadid) + "frame%03d.png' -frames:v "
-		+ std::to_string(job.num_frames) + "  -c:v libx264 -pix_fmt yuv420p -movflags +faststart "
-		+ job.output_file.native();
+	class FrameRenderer
+		// Renders a series of frames of the same size and style with either
+		// backend, and hands them out at their final size.
+	{
+		bool const raycast;
+		unsigned const width, height;
+		vector<boost::gil::rgb8_pixel_t> buf; // twice the final size, for OSMesa
+		unique_ptr<RenderResources> own_resources;
+		RenderResources * resources = nullptr;
+		Style const * style = nullptr;
+		RayCaster caster;
+
+	public:
+
+		vector<boost::gil::rgb8_pixel_t> frame;
+
+		FrameRenderer(
+			ImageMaker const & maker,
+			unsigned const w, unsigned const h, V3 const bg_color,
+			unsigned const grid_size = 2, unsigned const grid_line_width = 2)
+			: raycast(maker.renderer == ImageMaker::Renderer::raycast)
+			, width(w), height(h)
+			, frame(w * h)
+		{
+			if (raycast)
+			{
+				caster.background_color = bg_color;
+				caster.grid_color = bg_color * .8;
+				caster.grid_size = grid_size;
+				caster.grid_line_width = grid_line_width / 2.;
+					// OSMesa draws the lines at twice the final size
+			}
+			else
+			{
+				buf.resize(width*2 * height*2);
+
+				if (maker.reuse_render_resources) resources = &render_resources();
+				else
+				{
+					own_resources.reset(new RenderResources);
+					resources = own_resources.get();
+				}
+
+				style = &resources->begin(buf, width*2, height*2, bg_color, grid_size, grid_line_width);
+			}
+		}
+
+		void render(View const & view, Position const & pos, Camera const & camera)
+		{
+			if (raycast)
+				caster.render(view, pos, camera, width, height, &frame.data()[0][0]);
+			else
+				resources->render(view, pos, camera, width*2, height*2, *style);
+		}
+
+		boost::gil::rgb8_pixel_t const * finish()
+			// Returns the frame rendered since the last call.
+		{
+			if (!raycast)
+			{
+				glFlush();
+				glFinish();
 
-	if (std::system(command.c_str()) != 0)
-		throw std::runtime_error("command failed: " + command);
+				resolve(buf, width, height, frame.data());
+			}
+
+			return frame.data();
+		}
+	};
+}
 
-	cout << '.' << std::flush;
+double ymax(Position const & pos)
+{
+	return std::max(.8, std::max(pos[player0][Head].y, pos[player1][Head].y));
 }
 
 void ImageMaker::png(
-	pair<Position, Camera> const * pos_b,
-	pair<Position, Camera> const * pos_e,
+	Position pos,
+	Camera const & camera,
 	unsigned const width, unsigned const height,
 	string const path, V3 const bg_color,
 	vector<View> const & view,
 	unsigned const grid_size, unsigned const grid_line_width)
 {
-	vector<boost::gil::rgb8_pixel_t> buf(width*2 * height*2);
+	FrameRenderer r(*this, width, height, bg_color, grid_size, grid_line_width);
 
-	if (!OSMesaMakeCurrent(ctx.context, buf.data(), GL_UNSIGNED_BYTE, width*2, height*2))
-		error("OSMesaMakeCurrent");
+	foreach (v : view) r.render(v, pos, camera);
 
-	Style style;
-	style.grid_size = grid_size;
-	style.grid_line_width = grid_line_width;
-	style.grid_color = bg_color * .8;
-	style.background_color = bg_color;
+	write_png(r.finish(), width, height, path);
+}
 
-	glClearAccum(0.0, 0.0, 0.0, 0.0);
-	glClear(GL_ACCUM_BUFFER_BIT);
+void ImageMaker::make_mp4(
+	string const filename,
+	string const linkname,
+	size_t const delay,
+	unsigned const width, unsigned const height,
+	V3 const bg_color,
+	View const & view,
+	function<vector<pair<Position, Camera>>()> make_pcs)
+{
+	store(filename, linkname, [&]
+		{
+			auto pcs = make_pcs();
 
-	PlayerDrawer playerDrawer;
+			assert(!pcs.empty());
+			if (no_anim) pcs.resize(1);
 
-	for (pair<Position, Camera> const * p = pos_b; p != pos_e; ++p)
-	{
-		renderWindow(
-			view,
-			{}, // no viables
-			graph, p->first, p->second,
-			none, // no highlighted joint
-			{}, // default colors
-			0, 0, width*2, height*2,
-			{},
-			style, playerDrawer);
-
-		glFinish();
-		glAccum(GL_ACCUM, 1. / (pos_e - pos_b));
-	}
+			if (svg)
+			{
+				write_file(res_dir + "/store/" + filename,
+					GrappleMap::svg(pcs, 25, view, width, height, svg_style(bg_color)));
+				return;
+			}
 
-	glAccum(GL_RETURN, 1.0);
+			// Frames are rendered, resolved and handed to the encoder one
+			// at a time, so memory use does not depend on the video's length,
+			// and ffmpeg encodes one frame while we render the next.
 
-	foreach (p : buf) std::swap(p[0], p[2]);
+			FrameRenderer r(*this, width, height, bg_color);
 
-	vector<boost::gil::rgb8_pixel_t> buf2(width * height);
+			Mp4Encoder encoder(res_dir + "/store/" + filename, width, height, png_frames);
 
-	auto xy = [&](unsigned x, unsigned y){ return buf[y*width*2+x]; };
+			foreach (pc : pcs)
+			{
+				r.render(view, pc.first, pc.second);
+				encoder.add(r.finish());
+			}
 
-	for (unsigned x = 0; x != width; ++x)
-	for (unsigned y = 0; y != height; ++y)
-	{
-		auto const & a = xy(x*2,  y*2  );
-		auto const & b = xy(x*2+1,y*2  );
-		auto const & c = xy(x*2,  y*2+1);
-		auto const & d = xy(x*2+1,y*2+1);
-
-		buf2[y*width+x][0] = (a[0] + b[0] + c[0] + d[0]) / 4;
-		buf2[y*width+x][1] = (a[1] + b[1] + c[1] + d[1]) / 4;
-		buf2[y*width+x][2] = (a[2] + b[2] + c[2] + d[2]) / 4;
-	}
-		// todo: clean up
+			encoder.finish();
+		});
+}
+
+void ImageMaker::png(
+	pair<Position, Camera> const * pos_b,
+	pair<Position, Camera> const * pos_e,
+	unsigned const width, unsigned const height,
+	string const path, V3 const bg_color,
+	vector<View> const & view,
+	unsigned const grid_size, unsigned const grid_line_width)
+{
+	assert(pos_b != pos_e);
+
+	// Motion blur: the poses are rendered one at a time, and accumulated
+	// with integer weights. Poses that move no joint by at least a pixel
+	// relative to the last rendered one are not rendered themselves, but
+	// add their weight to it.
+
+	FrameRenderer r(*this, width, height, bg_color, grid_size, grid_line_width);
+
+	vector<std::uint32_t> sums(width * height * 3);
+	std::uint32_t total_weight = 0;
+
+	auto add = [&](pair<Position, Camera> const & p, std::uint16_t const weight)
+		{
+			foreach (v : view) r.render(v, p.first, p.second);
+			accumulate(&r.finish()[0][0], sums.size(), weight, sums.data());
+			total_weight += weight;
+		};
+
+	pair<Position, Camera> const * sample = pos_b;
+	std::uint16_t weight = 1;
+
+	for (pair<Position, Camera> const * p = pos_b + 1; p != pos_e; ++p)
+		if (weight != 255 && screen_motion(*sample, *p, view, width, height) < 1)
+			++weight;
+		else
+		{
+			add(*sample, weight);
+			sample = p;
+			weight = 1;
+		}
+
+	add(*sample, weight);
 
-	boost::gil::png_write_view(path,
-		boost::gil::flipped_up_down_view(boost::gil::interleaved_view(width, height, buf2.data(), width*3)));
+	vector<boost::gil::rgb8_pixel_t> out(width * height);
+	average(sums.data(), sums.size(), total_weight, &out.data()[0][0]);
+	write_png(out.data(), width, height, path);
 }
 
 void ImageMaker::png(
@@ -306,38 +517,118 @@ void ImageMaker::png(
 	string const path,
 	unsigned const width, unsigned const height, V3 const bg_color)
 {
-	Camera camera;
-	camera.hardSetOffset({0, ymax - 0.57, 0});
-	camera.zoom(0.55);
-	camera.rotateHorizontal(angle);
-	camera.rotateVertical((ymax - 0.6)/2);
+	png(pos, heading_camera(ymax, angle), width, height, path, bg_color, {{0, 0, 1, 1, none, 45}});
+}
 
-	png(pos, camera, width, height, path, bg_color, {{0, 0, 1, 1, none, 45}});
+void ImageMaker::blurred_png(
+	vector<Position> const & frames, Heading const heading,
+	unsigned const width, unsigned const height, BgColor const bg_color,
+	string const path)
+{
+	vector<double> const ymaxes = smooth_ymaxes(frames);
+
+	vector<pair<Position, Camera>> pcs;
+
+	for (size_t i = 0; i != frames.size(); ++i)
+		pcs.emplace_back(frames[i], heading_camera(ymaxes[i], angle(heading)));
+
+	png(pcs.data(), pcs.data() + pcs.size(), width, height, path, color(bg_color), {{0, 0, 1, 1, none, 45}});
 }
 
-void ImageMaker::store(
-	string const & filename,
-	string const & linkname,
-	std::function<void()> write_file)
+ContentKey ImageMaker::image_key() const
 {
+	ContentKey k;
+	k << render_version << renderer << svg;
+	return k;
+}
+
+ImageMaker::Claimed ImageMaker::claim(string const & filename, string const & linkname)
+{
+	manifest.use(filename, linkname);
+
 	bool const
-		file_exists = elem(filename, stored_initially),
-		link_exists = elem(linkname, linked_initially);
+		file_exists = manifest.has_file(filename),
+		link_exists = manifest.has_link(linkname, filename);
 
-	if (file_exists && link_exists) return;
+	if (file_exists && link_exists) return {Claim::done, {}};
 
-	string const link_target = "store/" + filename;
 	string const link_path = res_dir + "/" + linkname;
 
 	unlink(link_path.c_str());
 
-	write_file();
+	if (file_exists) return {Claim::link_only, {}};
+
+	std::lock_guard<std::mutex> lock(store_mutex);
+
+	auto const i = being_stored.find(filename);
+
+	if (i != being_stored.end()) return {Claim::link_only, i->second.written};
+		// Another thread is writing it, or has. The symlink can be made
+		// already, but whoever uses the file must wait for it.
+
+	Storing & s = being_stored[filename];
+	s.written = s.done.get_future().share();
+	return {Claim::write, {}};
+}
+
+void ImageMaker::stored(string const & filename)
+{
+	std::lock_guard<std::mutex> lock(store_mutex);
+	being_stored.at(filename).done.set_value();
+}
+
+void ImageMaker::abandon(string const & filename, std::exception_ptr const e)
+{
+	boost::system::error_code ec;
+	fs::remove(res_dir + "/store/" + filename, ec);
+
+	std::lock_guard<std::mutex> lock(store_mutex);
+	auto const i = being_stored.find(filename);
+	i->second.done.set_exception(e); // so that waiting threads fail too
+	being_stored.erase(i);
+}
+
+void ImageMaker::link(string const & filename, string const & linkname)
+{
+	string const link_target = "store/" + filename;
+	string const link_path = res_dir + "/" + linkname;
 
 	if (symlink(link_target.c_str(), link_path.c_str()))
 		perror("symlink");
+	else
+		manifest.add_link(linkname, filename);
 }
 
-void ImageMaker::png(
+void ImageMaker::store(
+	string const & filename,
+	string const & linkname,
+	std::function<void()> write_file)
+{
+	Claimed const c = claim(filename, linkname);
+
+	if (c.claim == Claim::done) return;
+	if (c.claim == Claim::write)
+	{
+		try
+		{
+			write_file();
+			manifest.add_file(filename);
+		}
+		catch (...)
+		{
+			abandon(filename, std::current_exception());
+			throw;
+		}
+
+		stored(filename);
+	}
+
+	link(filename, linkname);
+
+	if (c.written.valid()) c.written.get(); // rethrows if the writer failed
+}
+
+string ImageMaker::png(
 	Position pos,
 	double const ymax,
 	ImageView const view,
@@ -346,8 +637,9 @@ void ImageMaker::png(
 {
 	string const
 		attrs = code(view) + to_string(width) + 'x' + to_string(height),
-		filename = to_string(hash_value(pos)) + attrs + '-' + to_string(bg_color) + ".png",
-		linkname = base_linkname + attrs + ".png";
+		ext = still_ext(view),
+		filename = (image_key() << pos << attrs << bg_color).str() + ext,
+		linkname = base_linkname + attrs + ext;
 
 	store(filename, linkname, [&]
 	{
@@ -355,7 +647,12 @@ void ImageMaker::png(
 
 		string const path = res_dir + "/store/" + filename;
 
-		if (view.heading)
+		if (view.heading && svg)
+		{
+			write_file(path, GrappleMap::svg(pos, heading_camera(ymax, angle(*view.heading)),
+				{0, 0, 1, 1, none, 45}, width, height, svg_style(color(bg_color))));
+		}
+		else if (view.heading)
 		{
 			png(pos, angle(*view.heading), ymax, path, width, height, color(bg_color));
 		}
@@ -368,6 +665,8 @@ void ImageMaker::png(
 		}
 		else abort();
 	});
+
+	return linkname;
 }
 
 string ImageMaker::rotation_gif(
@@ -377,33 +676,23 @@ string ImageMaker::rotation_gif(
 {
 	if (view.mirror) p = mirror(p);
 
-	string const base_filename = to_string(hash_value(p)) + "rot" + to_string(bg_color);
-	string const mp4_filename = base_filename + ".mp4";
+	string const mp4_filename
+		= (image_key() << p << "rot" << width << height << bg_color).str() + anim_ext();
 
 	string const linkname =
 		base_linkname +
 		to_string(width) + 'x' + to_string(height) +
-		'c' + to_string(bg_color) + ".mp4";
+		'c' + to_string(bg_color) + anim_ext();
 
 	make_mp4(mp4_filename, linkname, 8, width, height, color(bg_color), {0, 0, 1, 1, none, 45},
 		[&]
 		{
-			double const ymax = std::max(.8, std::max(p[player0][Head].y, p[player1][Head].y));
+			double const y = ymax(p);
 
 			vector<pair<Position, Camera>> pcs;
 
 			for (auto i = 0; i < 360; i += 5)
-			{
-				double angle = i/180.*pi();
-
-				Camera camera;
-				camera.hardSetOffset({0, ymax - 0.57, 0});
-				camera.zoom(0.55);
-				camera.rotateHorizontal(angle);
-				camera.rotateVertical((ymax - 0.6)/2);
-
-				pcs.emplace_back(p, camera);
-			}
+				pcs.emplace_back(p, heading_camera(y, i/180.*pi()));
 
 			return pcs;
 		});
@@ -422,42 +711,22 @@ string ImageMaker::gif(
 
 	string const attrs = to_string(width) + 'x' + to_string(height) + code(view);
 
-	string filename
-		= to_string(boost::hash_value(frames))
-		+ attrs + '-' + to_string(bg_color) + ".mp4";
+	string const filename = (image_key() << frames << attrs << bg_color).str() + anim_ext();
 
-	string const linkname = base_linkname + attrs + ".mp4";
+	string const linkname = base_linkname + attrs + anim_ext();
 
 	if (view.heading)
 		make_mp4(filename, linkname, 3, width, height, color(bg_color), {0, 0, 1, 1, none, 45},
 			[&]
 			{
-				vector<double> ymaxes;
-				foreach (pos : frames)
-					ymaxes.push_back(std::max(.8, std::max(pos[player0][Head].y, pos[player1][Head].y)));
-				for (int i = 0; i != 10; ++i)
-					ymaxes = smoothen_v(ymaxes);
+				vector<double> const ymaxes = smooth_ymaxes(frames);
 
 				vector<pair<Position, Camera>> pcs;
 
-				int i = 0;
-				foreach (pos : frames)
-				{
-					auto qos = pos;
-					if (view.mirror) qos = mirror(pos);
-
-					double ymax = ymaxes[i];
-
-					Camera camera;
-					camera.hardSetOffset({0, ymax - 0.57, 0});
-					camera.zoom(0.55);
-					camera.rotateHorizontal(angle(*view.heading));
-					camera.rotateVertical((ymax - 0.6)/2);
-
-					pcs.emplace_back(qos, camera);
-
-					++i;
-				}
+				for (size_t i = 0; i != frames.size(); ++i)
+					pcs.emplace_back(
+						view.mirror ? mirror(frames[i]) : frames[i],
+						heading_camera(ymaxes[i], angle(*view.heading)));
 
 				return pcs;
 			});
@@ -472,90 +741,149 @@ string ImageMaker::gifs(
 {
 	string const
 		attrs = to_string(width) + 'x' + to_string(height) + '-' + to_string(bg_color),
-		base_filename = to_string(boost::hash_value(frames)) + attrs,
 		ext_linkbase = base_linkname + attrs;
 
+	ContentKey const base_key = image_key() << frames << attrs;
+
+	struct Video { ImageView view; string filename, linkname; bool stored; };
+
+	vector<Video> todo;
+	vector<std::shared_future<void>> others; // videos being written by other threads
+
 	foreach (view : views())
 	{
+		if (!view.heading) continue;
+
 		string const
-			suffix = code(view) + string(".mp4"),
-			filename = base_filename + suffix,
+			suffix = code(view) + anim_ext(),
+			filename = (ContentKey(base_key) << code(view)).str() + anim_ext(),
 			linkname = ext_linkbase + suffix;
 
-		if (view.heading)
-			make_mp4(filename, linkname, 3, width, height, color(bg_color), {0, 0, 1, 1, none, 45},
-				[&]
-				{
-					vector<double> ymaxes;
-					foreach (pos : frames)
-						ymaxes.push_back(std::max(.8, std::max(pos[player0][Head].y, pos[player1][Head].y)));
-					for (int i = 0; i != 10; ++i)
-						ymaxes = smoothen_v(ymaxes);
+		Claimed const c = claim(filename, linkname);
+
+		switch (c.claim)
+		{
+			case Claim::done: break;
+			case Claim::link_only:
+				link(filename, linkname);
+				if (c.written.valid()) others.push_back(c.written);
+				break;
+			case Claim::write: todo.push_back({view, filename, linkname, false}); break;
+		}
+	}
 
+	auto const store = [&](Video & v)
+		{
+			manifest.add_file(v.filename);
+			stored(v.filename);
+			v.stored = true;
+			link(v.filename, v.linkname);
+		};
+
+	try
+	{
+		if (!todo.empty())
+		{
+			vector<double> const ymaxes = smooth_ymaxes(frames);
+
+			if (svg)
+			{
+				foreach (v : todo)
+				{
 					vector<pair<Position, Camera>> pcs;
 
-					int i = 0;
-					foreach (pos : frames)
-					{
-						double ymax = ymaxes[i];
+					for (size_t i = 0; i != (no_anim ? 1 : frames.size()); ++i)
+						pcs.emplace_back(
+							v.view.mirror ? mirror(frames[i]) : frames[i],
+							heading_camera(ymaxes[i], angle(*v.view.heading)));
+
+					write_file(res_dir + "/store/" + v.filename,
+						GrappleMap::svg(pcs, 25, {0, 0, 1, 1, none, 45}, width, height, svg_style(color(bg_color))));
+
+					store(v);
+				}
+			}
+			else
+			{
+				// All views are rendered frame by frame in one pass, so that each
+				// frame (and its mirror image) is only tessellated once.
+
+				vector<unique_ptr<Mp4Encoder>> encoders;
+				foreach (v : todo)
+					encoders.emplace_back(new Mp4Encoder(res_dir + "/store/" + v.filename, width, height, png_frames));
+
+				FrameRenderer r(*this, width, height, color(bg_color));
 
-						Camera camera;
-						camera.hardSetOffset({0, ymax - 0.57, 0});
-						camera.zoom(0.55);
-						camera.rotateHorizontal(angle(*view.heading));
-						camera.rotateVertical((ymax - 0.6)/2);
+				for (size_t i = 0; i != (no_anim ? 1 : frames.size()); ++i)
+				{
+					Position const mirrored = mirror(frames[i]);
 
-						pcs.emplace_back(pos, camera);
+					for (size_t k = 0; k != todo.size(); ++k)
+					{
+						ImageView const & view = todo[k].view;
 
-						if (view.mirror)
-							pcs.back().first = mirror(pcs.back().first);
+						r.render({0, 0, 1, 1, none, 45},
+							view.mirror ? mirrored : frames[i],
+							heading_camera(ymaxes[i], angle(*view.heading)));
 
-						++i;
+						encoders[k]->add(r.finish());
 					}
+				}
 
-					return pcs;
-				});
+				foreach (e : encoders) e->finish();
+
+				foreach (v : todo) store(v);
+			}
+		}
+	}
+	catch (...)
+	{
+		foreach (v : todo)
+			if (!v.stored) abandon(v.filename, std::current_exception());
+		throw;
 	}
 
+	foreach (w : others) w.get(); // rethrows if the writer failed
+
 	return ext_linkbase;
 }
 
 ImageMaker::ImageMaker(Graph const & g, string rd)
 	: graph(g)
-	, ctx(OSMesaCreateContextExt(OSMESA_RGB, 16, 0, 16, nullptr))
-	, video_generators(1)
-    , res_dir(rd)
+	, manifest(rd)
+	, res_dir(rd)
 {
-	for (fs::directory_iterator i(res_dir + "/store"), e; i != e; ++i)
-		stored_initially.insert(fs::path(*i).filename().native());
+	cout << "Found " << manifest.file_count() << " existing items and "
+		<< manifest.link_count() << " existing links in store manifest.\n";
 
-	for (fs::directory_iterator i(res_dir), e; i != e; ++i)
-		if (is_symlink(*i))
-			linked_initially.insert(fs::path(*i).filename().native());
-
-	cout << "Found " << stored_initially.size() << " existing items and "
-		<< linked_initially.size() << " existing links in store.\n";
-
-	if (!ctx.context) error("OSMeseCreateContextExt failed");
+	signal(SIGPIPE, SIG_IGN);
+		// so that an ffmpeg that exits early shows up as a write error
 }
 
-void ImageMaker::make_svg(string const & filename, string const & dot) const
+string ImageMaker::dot_to_svg(string const & dot) const
 {
-	string
-		dotpath = res_dir + "/tmp.dot",
-		svgpath = res_dir + "/store/" + filename;
-	
-	{ std::ofstream dotfile(dotpath); dotfile << dot; }
-
-	FILE * fp = fopen(dotpath.c_str(), "r");
-	FILE * op = fopen(svgpath.c_str(), "w");
-	Agraph_t *g = agread(fp, 0);
-	gvLayout(gvc, g, "dot");
-	gvRender(gvc, g, "svg", op);
+	std::lock_guard<std::mutex> lock(gvc_mutex);
+
+	Agraph_t * const g = agmemread(dot.c_str());
+	if (!g) error("could not parse dot graph");
+
+	char * data = nullptr;
+	unsigned length = 0;
+
+	bool const ok =
+		gvLayout(gvc, g, "dot") == 0 &&
+		gvRenderData(gvc, g, "svg", &data, &length) == 0;
+
+	string r;
+	if (ok) r.assign(data, length);
+
+	if (data) gvFreeRenderData(data);
 	gvFreeLayout(gvc, g);
 	agclose(g);
-	fclose(fp);
-	fclose(op);
+
+	if (!ok) error("graphviz failed");
+
+	return r;
 
 	// doing this in-process rather than with std::system ensures that
 	// mkpospages sees ctrl-C and can handle it gracefully
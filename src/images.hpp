@@ -4,119 +4,19 @@
 #include "graph.hpp"
 #include "headings.hpp"
 #include "rendering.hpp"
+#include "manifest.hpp"
 #include <GL/osmesa.h>
-#include <unordered_set>
+#include <unordered_map>
 #include <boost/filesystem.hpp>
 #include <gvc.h>
-#include <future>
-#include <queue>
-#include <thread>
 #include <mutex>
+#include <future>
 #include <boost/gil/gil_all.hpp>
 
-template<typename Data>
-class concurrent_queue
-{
-	std::queue<Data> q;
-	mutable std::mutex m;
-	std::condition_variable nonempty;
-	std::condition_variable nonfull;
-	bool nothing_new = false;
-
-	bool full() const
-	{
-		return q.size() > 16;
-	}
-
-public:
-
-	void finish()
-	{
-		std::unique_lock<std::mutex> lock(m);
-		nothing_new = true;
-		lock.unlock();
-		nonempty.notify_all();
-	}
-
-	void push(Data data)
-	{
-		assert(!nothing_new);
-
-		std::unique_lock<std::mutex> lock(m);
-		while (full()) nonfull.wait(lock);
-
-		q.push(std::move(data));
-
-		lock.unlock();
-		nonempty.notify_one();
-	}
-
-	bool pop(Data & out) // returns false if queue exhausted
-	{
-		std::unique_lock<std::mutex> lock(m);
-
-		while (q.empty())
-		{
-			if (nothing_new) return false;
-
-			nonempty.wait(lock);
-		}
-
-		out = std::move(q.front());
-		q.pop();
-
-		lock.unlock();
-		nonfull.notify_one();
-		return true;
-	}
-};
-
-template<typename Job>
-class ThreadPool
-{
-	concurrent_queue<Job> jobs;
-	std::vector<std::thread> workers;
-
-	void work(size_t const threadid)
-	{
-		Job job;
-		while (jobs.pop(job))
-			process(job, threadid);
-	}
-
-	public:
-
-		explicit ThreadPool(size_t const n)
-		{
-			for (size_t i = 0; i != n; ++i)
-				workers.emplace_back([this, i]{ work(i); });
-		}
-
-		~ThreadPool()
-		{
-			jobs.finish();
-			foreach (w : workers) w.join();
-		}
-
-		ThreadPool(ThreadPool const &) = delete;
-
-		void add_job(Job j) { jobs.push(std::move(j)); }
-};
-
 namespace GrappleMap {
 
 namespace fs = boost::filesystem;
 
-struct VideoGenerationJob
-{
-	fs::path output_file;
-	size_t num_frames;
-	unsigned width, height;
-	vector<boost::gil::rgb8_pixel_t> tiled_frames;
-};
-
-void process(VideoGenerationJob const &, size_t thread_id);
-
 struct OSMesaContextPtr
 {
 	OSMesaContext context = nullptr;
@@ -129,13 +29,40 @@ struct OSMesaContextPtr
 	}
 };
 
+double ymax(Position const &);
+	// the height that heading images of a still are framed for
+
 class ImageMaker
 {
 	Graph const & graph;
-	OSMesaContextPtr ctx;
 	GVC_t *gvc = gvContext();
-	std::unordered_set<string> stored_initially, linked_initially;
-	ThreadPool<VideoGenerationJob> video_generators;
+	mutable std::mutex gvc_mutex; // graphviz is not reentrant
+	Manifest manifest;
+	struct Storing
+	{
+		std::promise<void> done;
+		std::shared_future<void> written;
+	};
+
+	std::mutex store_mutex;
+	std::unordered_map<string, Storing> being_stored;
+		// claimed by a thread this run, and kept once written
+
+	enum class Claim { done, link_only, write };
+
+	struct Claimed
+	{
+		Claim claim;
+		std::shared_future<void> written;
+			// for link_only: if valid, the file is not there until this is ready
+	};
+
+	Claimed claim(string const & filename, string const & linkname);
+		// A write claim must be followed by stored() or abandon().
+	void stored(string const & filename);
+	void abandon(string const & filename, std::exception_ptr);
+		// removes what was written of the file and lets it be claimed again
+	void link(string const & filename, string const & linkname);
 
 	void png(
 		Position pos, double angle, double ymax, string filename,
@@ -165,8 +92,35 @@ public:
 	string const res_dir;
 
 	bool no_anim = false;
+	bool png_frames = false; // pass frames to ffmpeg as PNG files instead of raw video
+
+	enum class Renderer { osmesa, raycast };
+
+	Renderer renderer = Renderer::osmesa;
+		// raycast renders without GL (see raycast.hpp), and so does not touch OSMesa at all.
+
+	bool reuse_render_resources = true;
+		// Whether OSMesa images share their thread's context, font, meshes and
+		// grid lists. Only turned off to measure what that saves (see imagebench.cpp).
+
+	bool svg = false;
+		// Write vector images (see svg.hpp) instead of PNGs and MP4s, except
+		// for first-person stills. Needs neither GL nor ffmpeg.
+
+	static constexpr unsigned render_version = 1;
+		// Part of every image's key. Bump when changing how images look.
+
+	ContentKey image_key() const;
+		// Starts a key with everything that affects all images.
+
+	size_t collect_garbage() { return manifest.collect_garbage(); }
+		// Only meaningful after a complete run. See Manifest.
+
+	string still_ext(ImageView const v) const { return svg && v.heading ? ".svg" : ".png"; }
+	string anim_ext() const { return svg ? ".svg" : ".mp4"; }
 
 	explicit ImageMaker(Graph const &, string res_dir /* e.g. path/to/GrappleMap/res */);
+		// All members may be called concurrently. Each thread renders into its own OSMesa context.
 
 	ImageMaker(ImageMaker const &) = delete;
 	ImageMaker & operator=(ImageMaker const &) = delete;
@@ -195,10 +149,18 @@ public:
 		}
 	}
 
-	void png(
+	string png(
 		Position, double ymax, ImageView,
 		unsigned width, unsigned height, BgColor,
 		string base_linkname);
+		// Returns the link name.
+
+	void blurred_png(
+		vector<Position> const & frames /* at least one */, Heading,
+		unsigned width, unsigned height, BgColor,
+		string path);
+		// One motion-blurred still of all frames, framed like gif's. Writes
+		// straight to path, bypassing the store (see imagebench.cpp).
 
 	string rotation_gif(
 		Position, ImageView,
@@ -224,7 +186,9 @@ public:
 		View const &,
 		function<vector<pair<Position, Camera>>()> make_pcs);
 
-	void make_svg(string const & filename, string const & dot) const;
+	string dot_to_svg(string const & dot) const;
+		// Lays out and renders a Graphviz graph without touching the disk.
+		// Calls are serialized, because Graphviz is not reentrant.
 };
 
 }
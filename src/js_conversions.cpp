@@ -1,5 +1,6 @@
 #include "js_conversions.hpp"
 #include "metadata.hpp"
+#include <cstdio>
 
 #ifdef EMSCRIPTEN
 #include <codecvt>
@@ -46,23 +47,6 @@ namespace GrappleMap
 		return r;
 	}
 
-	val tojsval(Position const & p)
-	{
-		vector<val> pl;
-
-		foreach (n : playerNums())
-		{
-			vector<val> v;
-
-			foreach (j : joints)
-				v.push_back(tojsval(p[n][j]));
-
-			pl.push_back(tojsval(v));
-		}
-
-		return tojsval(pl);
-	}
-
 	val desc_tojsval(vector<string> const & desc)
 	{
 		vector<std::wstring> lines;
@@ -92,10 +76,6 @@ namespace GrappleMap
 	{
 		Graph::Edge const & edge = graph[s];
 
-		vector<val> frames;
-		if (!light)
-			foreach (pos : edge.positions) frames.push_back(tojsval(pos));
-
 		auto r = val::object();
 		r.set("id", s.index);
 		if (light)
@@ -108,7 +88,7 @@ namespace GrappleMap
 			r.set("from", tojsval(edge.from));
 			r.set("to", tojsval(edge.to));
 		}
-		if (!light) r.set("frames", tojsval(frames));
+		r.set("frame_count", edge.positions.size());
 		r.set("description", desc_tojsval(edge.description));
 		r.set("tags", tojsval(tags(edge)));
 		r.set("properties", tojsval(properties_in_desc(edge.description)));
@@ -116,7 +96,7 @@ namespace GrappleMap
 		return r;
 	}
 
-	val to_elaborate_jsval(NodeNum const n, Graph const & graph, bool const light)
+	val to_elaborate_jsval(NodeNum const n, Graph const & graph)
 	{
 	/*
 		set<string> disc;
@@ -132,7 +112,6 @@ namespace GrappleMap
 		node.set("id", n.index);
 		node.set("incoming", tojsval(incoming));
 		node.set("outgoing", tojsval(outgoing));
-		if (!light) node.set("position", tojsval(graph[n].position));
 		node.set("description", desc_tojsval(graph[n].description));
 		node.set("tags", tojsval(tags(graph[n])));
 	//	js << ",discriminators:";
@@ -150,12 +129,46 @@ namespace GrappleMap
 		return v;
 	}
 
+	val tojsval(QueryResult const & q)
+	{
+		vector<uint32_t> nodes, transitions;
+		foreach (n : q.nodes) nodes.push_back(n.index);
+		foreach (s : q.transitions) transitions.push_back(s.index);
+
+		vector<val> refinements;
+		foreach (x : q.refinements)
+		{
+			auto v = val::object();
+			v.set("tag", x.tag);
+			v.set("nodes_in", x.nodes_in);
+			v.set("nodes_out", x.nodes_out);
+			v.set("trans_in", x.trans_in);
+			v.set("trans_out", x.trans_out);
+			refinements.push_back(v);
+		}
+
+		auto r = val::object();
+		r.set("nodes", tojsval(nodes));
+		r.set("transitions", tojsval(transitions));
+		r.set("refinements", tojsval(refinements));
+		return r;
+	}
+
+	TagQuery tag_query_fromjsval(val const & v)
+	{
+		TagQuery q;
+		unsigned const n = v["length"].as<unsigned>();
+		for (unsigned i = 0; i != n; ++i)
+			q.emplace(v[i][0].as<std::string>(), v[i][1].as<bool>());
+		return q;
+	}
+
 	val to_elaborate_jsval(Graph const & g, bool const light)
 	{
 		vector<val> nodes, transitions;
 
 		foreach (n : nodenums(g))
-			nodes.push_back(to_elaborate_jsval(n, g, light));
+			nodes.push_back(to_elaborate_jsval(n, g));
 		foreach (s : seqnums(g))
 			transitions.push_back(to_elaborate_jsval(s, g, light));
 
@@ -310,4 +323,147 @@ namespace GrappleMap
 		tojs(tags(graph), js);
 		js << ";\n\n";
 	}
+
+	void json_string(string const & s, std::ostream & js)
+	{
+		js << '"';
+		foreach (c : s)
+			if (c == '"' || c == '\\') js << '\\' << c;
+			else if (c == '\n') js << "\\n";
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char buf[7];
+				snprintf(buf, sizeof buf, "\\u%04x", unsigned(c));
+				js << buf;
+			}
+			else js << c;
+		js << '"';
+	}
+
+	template<typename R>
+	void json_strings(R const & v, std::ostream & js)
+	{
+		js << '[';
+		bool first = true;
+		foreach (s : v)
+		{
+			if (first) first = false; else js << ',';
+			json_string(s, js);
+		}
+		js << ']';
+	}
+
+	void tojson(V3 const v, std::ostream & js)
+	{
+		js << "{\"x\":" << v.x << ",\"y\":" << v.y << ",\"z\":" << v.z << '}';
+	}
+
+	void tojson(Step const s, std::ostream & js)
+	{
+		js << "{\"transition\":" << s->index << ",\"reverse\":" << (s.reverse ? "true" : "false") << '}';
+	}
+
+	void tojson(ReorientedNode const & n, std::ostream & js)
+	{
+		PositionReorientation const & reo = n.reorientation;
+
+		js << "{\"node\":" << n->index
+			<< ",\"reo\":{\"mirror\":" << (reo.mirror ? "true" : "false")
+			<< ",\"swap_players\":" << (reo.swap_players ? "true" : "false")
+			<< ",\"angle\":" << reo.reorientation.angle
+			<< ",\"offset\":";
+		tojson(reo.reorientation.offset, js);
+		js << "}}";
+	}
+
+	void tojson(NodeNum const n, Graph const & graph, std::ostream & js)
+	{
+		set<string> disc;
+		foreach (p : query_for(graph, n))
+			if (!p.second) disc.insert(p.first);
+
+		js << "{\"id\":" << n.index << ",\"incoming\":[";
+		bool first = true;
+		foreach (s : graph[n].in)
+		{
+			if (first) first = false; else js << ',';
+			tojson(s, js);
+		}
+		js << "],\"outgoing\":[";
+		first = true;
+		foreach (s : graph[n].out)
+		{
+			if (first) first = false; else js << ',';
+			tojson(s, js);
+		}
+		js << "],\"position\":[";
+			// players, joints, xyz, like positionOf in web_db_loader.cpp
+		first = true;
+		foreach (pn : playerNums())
+		foreach (j : joints)
+		{
+			V3 const v = graph[n].position[pn][j];
+			if (first) first = false; else js << ',';
+			js << v.x << ',' << v.y << ',' << v.z;
+		}
+		js << "],\"description\":";
+		json_strings(graph[n].description, js);
+		js << ",\"tags\":";
+		json_strings(tags(graph[n]), js);
+		js << ",\"discriminators\":";
+		json_strings(disc, js);
+		if (graph[n].line_nr)
+			js << ",\"line_nr\":" << *graph[n].line_nr;
+		js << '}';
+	}
+
+	void tojson(SeqNum const s, Graph const & graph, std::ostream & js)
+	{
+		Graph::Edge const & edge = graph[s];
+
+		js << "{\"id\":" << s.index;
+		js << ",\"from\":"; tojson(edge.from, js);
+		js << ",\"to\":"; tojson(edge.to, js);
+		js << ",\"frame_count\":" << edge.positions.size();
+		js << ",\"description\":";
+		json_strings(edge.description, js);
+		js << ",\"tags\":";
+		json_strings(tags(edge), js);
+		js << ",\"properties\":";
+		json_strings(properties_in_desc(edge.description), js);
+		if (edge.line_nr)
+			js << ",\"line_nr\":" << *edge.line_nr;
+		js << '}';
+	}
+
+	void tojson(QueryResult const & q, std::ostream & js)
+	{
+		js << "{\"nodes\":[";
+		bool first = true;
+		foreach (n : q.nodes)
+		{
+			if (first) first = false; else js << ',';
+			js << n.index;
+		}
+		js << "],\"transitions\":[";
+		first = true;
+		foreach (s : q.transitions)
+		{
+			if (first) first = false; else js << ',';
+			js << s.index;
+		}
+		js << "],\"refinements\":[";
+		first = true;
+		foreach (x : q.refinements)
+		{
+			if (first) first = false; else js << ',';
+			js << "{\"tag\":";
+			json_string(x.tag, js);
+			js << ",\"nodes_in\":" << x.nodes_in
+				<< ",\"nodes_out\":" << x.nodes_out
+				<< ",\"trans_in\":" << x.trans_in
+				<< ",\"trans_out\":" << x.trans_out << '}';
+		}
+		js << "]}";
+	}
 }
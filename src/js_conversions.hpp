@@ -6,7 +6,7 @@
 #include <emscripten/bind.h>
 #endif
 
-#include "graph_util.hpp"
+#include "query_engine.hpp"
 
 namespace GrappleMap
 {
@@ -33,7 +33,14 @@ namespace GrappleMap
 	val tojsval(NodeNum, Graph const &);
 	val tojsval(SeqNum, Graph const &);
 
+	val tojsval(QueryResult const &);
+
+	TagQuery tag_query_fromjsval(val const &);
+		// from [tag, include] pairs, like search.js's selected_tags
+
 	val to_elaborate_jsval(Graph const &, bool light);
+		// Metadata only. Frames and positions are too big to convert
+		// eagerly; see framesOf and positionOf in web_db_loader.cpp.
 
 	#endif
 
@@ -41,6 +48,17 @@ namespace GrappleMap
 	void tojs(PositionReorientation const &, std::ostream &);
 	void tojs(SeqNum, Graph const &, std::ostream &);
 	void tojs(Graph const &, std::ostream &);
+
+	void json_string(string const &, std::ostream &);
+
+	void tojson(NodeNum, Graph const &, std::ostream &);
+	void tojson(SeqNum, Graph const &, std::ostream &);
+		// Strict JSON for a single node or transition, laid out like
+		// to_elaborate_jsval's, except that nodes include their position
+		// and discriminators. Transition frames are not included.
+
+	void tojson(QueryResult const &, std::ostream &);
+		// ids, and refinements as {tag, nodes_in, nodes_out, trans_in, trans_out}
 }
 
 #endif
@@ -0,0 +1,227 @@
+#include "manifest.hpp"
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <cstdio>
+
+namespace GrappleMap {
+
+namespace fs = boost::filesystem;
+
+// Every field is terminated, so that different sequences of fields
+// never feed the same bytes to the hash.
+
+ContentKey & ContentKey::operator<<(string const & s)
+{
+	*this << long(s.size());
+	md5.update(s.data(), s.size());
+	return *this;
+}
+
+ContentKey & ContentKey::operator<<(char const c)
+{
+	char const b[] = {c, ';'};
+	md5.update(b, 2);
+	return *this;
+}
+
+ContentKey & ContentKey::operator<<(long const i)
+{
+	string const s = to_string(i) + ';';
+	md5.update(s.data(), s.size());
+	return *this;
+}
+
+ContentKey & ContentKey::operator<<(double const d)
+{
+	return *this << long(std::lround(d * 10000));
+}
+
+ContentKey & ContentKey::operator<<(V3 const v)
+{
+	return *this << v.x << v.y << v.z;
+}
+
+ContentKey & ContentKey::operator<<(Position const & p)
+{
+	foreach (j : playerJoints) *this << p[j];
+	return *this;
+}
+
+ContentKey & ContentKey::operator<<(vector<Position> const & v)
+{
+	*this << long(v.size());
+	foreach (p : v) *this << p;
+	return *this;
+}
+
+string ContentKey::str() const
+{
+	MD5 m = md5;
+	return m.finalize().hexdigest();
+}
+
+namespace
+{
+	string const manifest_name = "MANIFEST";
+}
+
+Manifest::Manifest(string const rd)
+	: res_dir(rd)
+{
+	string const store = res_dir + "/store/";
+
+	if (std::ifstream f{store + manifest_name})
+	{
+		// Later lines override earlier ones. Entries for files that have
+		// since been removed or truncated, and for links that no longer
+		// exist, are dropped.
+
+		string kind;
+		while (f >> kind)
+			if (kind == "f")
+			{
+				File file;
+				string name;
+				f >> file.size >> file.written >> name;
+				files[name] = file;
+			}
+			else if (kind == "l")
+			{
+				string filename, linkname;
+				f >> filename >> linkname;
+				links[linkname] = filename;
+			}
+			else error("corrupt " + store + manifest_name);
+
+		for (auto i = files.begin(); i != files.end(); )
+		{
+			boost::system::error_code ec;
+			auto const size = fs::file_size(store + i->first, ec);
+			if (ec || size != i->second.size) i = files.erase(i);
+			else ++i;
+		}
+
+		for (auto i = links.begin(); i != links.end(); )
+			if (!fs::is_symlink(fs::symlink_status(res_dir + "/" + i->first))) i = links.erase(i);
+			else ++i;
+	}
+
+	rewrite();
+}
+
+void Manifest::rewrite()
+{
+	string const
+		path = res_dir + "/store/" + manifest_name,
+		tmp = path + ".tmp";
+
+	if (log.is_open()) log.close();
+
+	{
+		std::ofstream f(tmp);
+
+		foreach (x : files)
+			f << "f " << x.second.size << ' ' << x.second.written << ' ' << x.first << '\n';
+
+		foreach (x : links)
+			f << "l " << x.second << ' ' << x.first << '\n';
+
+		f.close();
+		if (!f) error("could not write " + tmp);
+	}
+
+	if (std::rename(tmp.c_str(), path.c_str()) != 0)
+		error("could not replace " + path);
+
+	log.open(path, std::ios::app);
+	if (!log) error("could not open " + path);
+}
+
+void Manifest::use(string const & filename, string const & linkname)
+{
+	std::lock_guard<std::mutex> lock(m);
+	used_files.insert(filename);
+	used_links.insert(linkname);
+}
+
+bool Manifest::has_file(string const & filename)
+{
+	std::lock_guard<std::mutex> lock(m);
+	return files.count(filename) != 0;
+}
+
+bool Manifest::has_link(string const & linkname, string const & filename)
+{
+	std::lock_guard<std::mutex> lock(m);
+	auto const i = links.find(linkname);
+	return i != links.end() && i->second == filename;
+}
+
+void Manifest::add_file(string const & filename)
+{
+	File const file{fs::file_size(res_dir + "/store/" + filename), std::time(nullptr)};
+
+	std::lock_guard<std::mutex> lock(m);
+	files[filename] = file;
+	log << "f " << file.size << ' ' << file.written << ' ' << filename << std::endl;
+}
+
+void Manifest::add_link(string const & linkname, string const & filename)
+{
+	std::lock_guard<std::mutex> lock(m);
+	links[linkname] = filename;
+	log << "l " << filename << ' ' << linkname << std::endl;
+}
+
+size_t Manifest::collect_garbage()
+{
+	std::lock_guard<std::mutex> lock(m);
+
+	vector<fs::path> garbage;
+
+	for (fs::directory_iterator i(res_dir + "/store"), e; i != e; ++i)
+	{
+		string const name = i->path().filename().native();
+
+		if (name.compare(0, manifest_name.size(), manifest_name) == 0) continue;
+		if (used_files.count(name)) continue;
+
+		files.erase(name);
+		garbage.push_back(i->path());
+	}
+
+	for (fs::directory_iterator i(res_dir), e; i != e; ++i)
+	{
+		if (!fs::is_symlink(fs::symlink_status(i->path()))) continue;
+
+		string const name = i->path().filename().native();
+
+		if (used_links.count(name)) continue;
+		if (fs::read_symlink(i->path()).native().compare(0, 6, "store/") != 0) continue;
+
+		links.erase(name);
+		garbage.push_back(i->path());
+	}
+
+	foreach (p : garbage) fs::remove(p);
+
+	size_t const removed = garbage.size();
+
+	rewrite();
+
+	return removed;
+}
+
+size_t Manifest::file_count()
+{
+	std::lock_guard<std::mutex> lock(m);
+	return files.size();
+}
+
+size_t Manifest::link_count()
+{
+	std::lock_guard<std::mutex> lock(m);
+	return links.size();
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef GRAPPLEMAP_MANIFEST_HPP
+#define GRAPPLEMAP_MANIFEST_HPP
+
+#include "positions.hpp"
+#include "md5.hpp"
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace GrappleMap
+{
+	class ContentKey
+		// A key for generated content that is the same on every platform and
+		// build: the MD5 of everything that goes into the content, with
+		// coordinates rounded to a tenth of a millimeter.
+	{
+		MD5 md5;
+
+	public:
+
+		ContentKey & operator<<(string const &);
+		ContentKey & operator<<(char const * s) { return *this << string(s); }
+		ContentKey & operator<<(char);
+		ContentKey & operator<<(long);
+		ContentKey & operator<<(double);
+		ContentKey & operator<<(V3);
+		ContentKey & operator<<(Position const &);
+		ContentKey & operator<<(vector<Position> const &);
+
+		template<typename T>
+		ContentKey & operator<<(T const i) { return *this << long(i); } // other integers and enums
+
+		string str() const; // 32 hex digits
+	};
+
+	class Manifest
+		// Record of the completed files in res/store and the symlinks to them
+		// in res, kept in res/store/MANIFEST.
+		//
+		// Entries are appended (and flushed) as soon as a file or link is
+		// complete, so a run that is interrupted resumes exactly where it
+		// stopped. A file that was only partly written has no entry and is
+		// made again.
+		//
+		// All members may be called concurrently.
+	{
+		struct File
+		{
+			std::uintmax_t size;
+			std::time_t written;
+		};
+
+		string const res_dir;
+		std::mutex m;
+		std::unordered_map<string, File> files;
+		std::unordered_map<string, string> links; // link name to file name
+		std::unordered_set<string> used_files, used_links; // this run
+		std::ofstream log;
+
+		void rewrite(); // compacts the log to the current entries
+
+	public:
+
+		explicit Manifest(string res_dir);
+
+		Manifest(Manifest const &) = delete;
+		Manifest & operator=(Manifest const &) = delete;
+
+		void use(string const & filename, string const & linkname);
+			// Marks both as needed by this run, for collect_garbage().
+
+		bool has_file(string const & filename);
+		bool has_link(string const & linkname, string const & filename);
+			// Whether linkname is known to point to filename.
+
+		void add_file(string const & filename);
+		void add_link(string const & linkname, string const & filename);
+
+		size_t collect_garbage();
+			// Removes store files and store links that were not used this run,
+			// as well as stray store files (e.g. from interrupted writes).
+			// Returns the number of files and links removed.
+
+		size_t file_count();
+		size_t link_count();
+	};
+}
+
+#endif
@@ -10,6 +10,9 @@
 #include "viables.hpp"
 #include "rendering.hpp"
 #include "images.hpp"
+#include "thumbnails.hpp"
+#include "tasks.hpp"
+#include "differ.hpp"
 #include "metadata.hpp"
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
@@ -17,21 +20,11 @@
 #include <iomanip>
 #include <vector>
 #include <fstream>
+#include <atomic>
 #include <signal.h>
 
 using namespace GrappleMap;
 
-inline std::size_t hash_value(V3 const v) // todo: put elsewhere
-{
-	size_t seed = 0;
-	boost::hash_combine(seed, v.x);
-	boost::hash_combine(seed, v.y);
-	boost::hash_combine(seed, v.z);
-	return seed;
-}
-
-#include <boost/functional/hash.hpp>
-
 #ifndef int_p_NULL // ffs
 	#define int_p_NULL (int*)NULL // https://github.com/ignf/gilviewer/issues/8
 #endif
@@ -50,6 +43,10 @@ namespace
 
 	string vid(string title, int width, int height, string src)
 	{
+		if (src.size() >= 4 && src.compare(src.size() - 4, 4, ".svg") == 0)
+			return "<img title='" + title + "' width='" + to_string(width) + "' height='" + to_string(height) + "' src='" + src + "'>";
+				// animated by its own CSS
+
 		return "<video title='" + title + "' autoplay='autoplay' loop='loop' width='" + to_string(width) + "' height='" + to_string(height) + "'>"
 			+ "<source src='" + src + "' type='video/mp4'/>"
 			+ "</video>";
@@ -72,6 +69,12 @@ namespace
 		string output_dir;
 		optional<string> image_url;
 		bool no_anim;
+		bool png_frames;
+		unsigned jobs;
+		ImageMaker::Renderer renderer;
+		bool svg;
+		bool gc;
+		optional<string> since;
 	};
 
 	template<typename T>
@@ -96,6 +99,24 @@ namespace
 				po::value<string>())
 			("no_anim",
 				po::value<bool>()->default_value(false))
+			("png_frames",
+				po::value<bool>()->default_value(false),
+				"pass frames to ffmpeg as PNG files rather than piping raw video")
+			("jobs,j",
+				po::value<unsigned>()->default_value(Executor::default_threads()),
+				"number of worker threads")
+			("renderer",
+				po::value<string>()->default_value("osmesa"),
+				"osmesa or raycast")
+			("svg",
+				po::value<bool>()->default_value(false),
+				"write SVG instead of PNG and MP4 images where possible")
+			("gc",
+				po::value<bool>()->default_value(false),
+				"after a complete run, remove stored files and links that it did not use")
+			("since",
+				po::value<string>(),
+				"only rebuild what changed relative to this older database")
 			("db",
 				po::value<string>()->default_value("GrappleMap.txt"),
 				"database file");
@@ -114,36 +135,39 @@ namespace
 			return none;
 		}
 
+		if (vm["gc"].as<bool>() && vm.count("since"))
+			error("--gc needs a complete run, so it cannot be combined with --since");
+
+		string const renderer = vm["renderer"].as<string>();
+
+		if (renderer != "osmesa" && renderer != "raycast")
+			error("unknown renderer: " + renderer);
+
 		return Config
 			{ vm["db"].as<string>()
 			, vm["output_dir"].as<string>()
 			, opt_arg<string>(vm, "image_url")
-			, vm["no_anim"].as<bool>() };
+			, vm["no_anim"].as<bool>()
+			, vm["png_frames"].as<bool>()
+			, vm["jobs"].as<unsigned>()
+			, renderer == "raycast" ? ImageMaker::Renderer::raycast : ImageMaker::Renderer::osmesa
+			, vm["svg"].as<bool>()
+			, vm["gc"].as<bool>()
+			, opt_arg<string>(vm, "since") };
 	}
 
-	vector<Position> frames_for_sequence(Graph const & graph, SeqNum const seqNum)
-	{
-		unsigned const frames_per_pos = graph[seqNum].detailed ? 3 : 5;
-
-		PositionInSequence location{seqNum, 0};
-
-		vector<Position> r(10, at(location, graph));
+	using SequenceFrames = Memo<SeqNum, vector<Position>>;
+		// Each sequence is shown on the pages of both its endpoints and
+		// as a standalone transition, so its frames are computed once.
 
-		for (; next(location, graph); location = *next(location, graph))
-			for (unsigned howfar = 0; howfar != frames_per_pos; ++howfar)
-				r.push_back(between(
-					at(location, graph),
-					at(*next(location, graph), graph),
-					howfar / double(frames_per_pos)));
-
-		r.resize(r.size() + 10, graph[seqNum].positions.back());
-
-		return r;
+	vector<Position> frames_for_sequence(Graph const & graph, SeqNum const seqNum, SequenceFrames & cache)
+	{
+		return cache(seqNum, [&]{ return frames_for_sequence(graph, seqNum); });
 	}
-	
-	vector<Position> frames_for_step(Graph const & graph, Step const step)
+
+	vector<Position> frames_for_step(Graph const & graph, Step const step, SequenceFrames & cache)
 	{
-		vector<Position> v = frames_for_sequence(graph, *step);
+		vector<Position> v = frames_for_sequence(graph, *step, cache);
 		if (step.reverse) std::reverse(v.begin(), v.end());
 		return v;
 	}
@@ -309,46 +333,6 @@ namespace
 		return r;
 	}
 
-	ImageMaker::BgColor bg_color(bool const top, bool const bottom)
-	{
-		if (top) return ImageMaker::RedBg;
-		if (bottom) return ImageMaker::BlueBg;
-		return ImageMaker::WhiteBg;
-	}
-
-	vector<Position> smoothen(vector<Position> v)
-	{
-		Position last_pos = v[0];
-
-		foreach (p : v)
-		foreach (j : playerJoints)
-		{
-			double const lag = std::min(0.55, 0.3 + p[j].y);
-			p[j] = last_pos[j] = last_pos[j] * lag + p[j] * (1 - lag);
-		}
-
-		return v;
-	}
-
-	void transition_gif(
-		ImageMaker & mkimg,
-		vector<Position> frames,
-		ImageView const v,
-		ImageMaker::BgColor const bg_color,
-		string const base_linkname)
-	{
-		mkimg.gif(smoothen(frames), v, 200, 150, bg_color, base_linkname);
-	}
-
-	string transition_gifs(
-		ImageMaker & mkimg,
-		vector<Position> frames,
-		ImageMaker::BgColor const bg_color,
-		string const base_linkname)
-	{
-		return mkimg.gifs(smoothen(frames), 200, 150, bg_color, base_linkname);
-	}
-
 	ImageView xmirror(ImageView const v)
 	{
 		assert(v.heading);
@@ -410,38 +394,48 @@ namespace
 		return distanceSquared(p[player0][Core], p[player1][Core]);
 	}
 
-	void write_transition_gifs(ImageMaker & mkimg, Graph const & g)
+	struct Build
 	{
-		cout << "Writing " << g.num_sequences() << " * 8 standalone transition gifs...   0%";
-
-		foreach (sn : seqnums(g))
-		{
-			if (!keep_running) break;
-
-			progress(sn.index, g.num_sequences());
+		Executor & executor;
+		ImageMaker & mkimg;
+		Graph const & graph;
+		SequenceFrames sequence_frames{256};
 
-			auto const props = properties(g[sn]);
+		std::atomic<size_t> items_done{0};
+		size_t items = 0;
+		std::mutex progress_mutex;
 
-			bool top = elem("top", props);
-			bool bottom = elem("bottom", props);
+		void item_done()
+		{
+			size_t const d = ++items_done;
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			progress(d, items);
+		}
+	};
 
-			auto frames = frames_for_sequence(g, sn);
+	void write_transition_gifs(Build & b, SeqNum const sn)
+	{
+		auto const frames = std::make_shared<vector<Position>>();
+		auto const bg = bg_color(b.graph, sn);
 
-			if (g[sn].from.reorientation.swap_players)
-				foreach (p : frames) swap_players(p);
+		auto prepare = b.executor.spawn([&b, sn, frames]
+			{
+				if (!keep_running) return;
 
-			auto const reo = canonical_reorientation_with_mirror(frames.front());
+				*frames = frames_for_sequence(b.graph, sn, b.sequence_frames);
+				orient_transition_frames(b.graph, sn, *frames);
+			});
 
-			foreach (p : frames) p = reo(p);
+		vector<Executor::Task> gifs;
 
-			foreach (v : views())
-				transition_gif(
-					mkimg, frames, v,
-					bg_color(top, bottom),
-					't' + to_string(sn.index));
-		}
+		foreach (v : views())
+			gifs.push_back(b.executor.spawn([&b, sn, frames, v, bg]
+				{
+					if (keep_running)
+						transition_gif(b.mkimg, *frames, v, bg, 't' + to_string(sn.index));
+				}, {prepare}));
 
-		std::endl(cout);
+		b.executor.spawn([&b]{ b.item_done(); }, gifs);
 	}
 
 	namespace position_page
@@ -455,7 +449,7 @@ namespace
 			NodeNum other_node;
 		};
 
-		ImageMaker::BgColor bg_color(Trans const & t) { return ::bg_color(t.top, t.bottom); }
+		ImageMaker::BgColor bg_color(Trans const & t) { return GrappleMap::bg_color(t.top, t.bottom); }
 		
 		struct Context
 		{
@@ -475,7 +469,7 @@ namespace
 					"../composer/index.html?" + to_string(trans.step->index),
 					vid(
 						transition_image_title(ctx.graph, *trans.step), 200, 150,
-						ctx.image_url + "/" + trans.base_filename + code(ctx.view) + ".mp4"))
+						ctx.image_url + "/" + trans.base_filename + code(ctx.view) + ctx.mkimg.anim_ext()))
 				+ " <em>to</em>";
 		}
 
@@ -575,47 +569,91 @@ namespace
 
 		void write_heading(Context const & ctx, ostream & html)
 		{
-			auto const pos_to_show = orient_canonically_with_mirror(ctx.graph[ctx.n].position);
-
-			double const ymax = std::max(.8, std::max(
-				pos_to_show[player0][Head].y,
-				pos_to_show[player1][Head].y));
-
-			ctx.mkimg.png(pos_to_show, ymax, ctx.view,
-				480, 360, ctx.mkimg.WhiteBg, 'p' + to_string(ctx.n.index));
-
-			ctx.mkimg.png(pos_to_show, ymax, ctx.view,
-				320, 240, ctx.mkimg.WhiteBg, 'p' + to_string(ctx.n.index));
+			string const image = position_image(ctx.mkimg, ctx.graph, ctx.n, ctx.view, 480, 360);
+			position_image(ctx.mkimg, ctx.graph, ctx.n, ctx.view, 320, 240);
 
 			html
 				<< "<h1><a href='https://github.com/Eelis/GrappleMap/'>GrappleMap</a></h1>"
 				<< "<h1>" << nlbr(desc(ctx.graph[ctx.n])) << "</h1>"
 				<< "<br><br>"
 				<< img(position_image_title(ctx.graph, ctx.n),
-					ctx.image_url + "/p" + to_string(ctx.n.index) + code(ctx.view) + "480x360.png"
-					, "")
+					ctx.image_url + "/" + image, "")
 				<< "<br>";
 		}
 
-		void write_page(Context const & ctx)
+		string neighbourhood_linkname(NodeNum const n, char const heading)
+		{
+			return "neighbourhood" + to_string(n.index) + heading + ".svg";
+		}
+
+		string retarget(string const & svg, char const from, char const to)
+			// Rewrites links to position pages in one view into links to
+			// the same pages in another, by changing the view code in
+			// every href="p<index><code>.html".
+		{
+			string r;
+			r.reserve(svg.size());
+
+			string const prefix = "href=\"p";
+			size_t i = 0;
+
+			for (size_t j; (j = svg.find(prefix, i)) != string::npos; )
+			{
+				j += prefix.size();
+				while (j != svg.size() && std::isdigit(svg[j])) ++j;
+
+				r.append(svg, i, j - i);
+				i = j;
+
+				if (svg.compare(j, 7, string(1, from) + ".html\"") == 0)
+				{
+					r += to;
+					++i;
+				}
+			}
+
+			r.append(svg, i, string::npos);
+			return r;
+		}
+
+		void write_neighbourhood(ImageMaker & mkimg, Graph const & graph, NodeNum const n)
+			// The views only differ in the view code in the links, so the
+			// graph is laid out (at most) once, and the other views are
+			// derived from that. The filenames remain keyed by each
+			// view's own dot source.
 		{
 			map<NodeNum, bool> m;
-			m[ctx.n] = true;
-			foreach(nn : nodes_around(ctx.graph, set<NodeNum>{ctx.n}, 2, true /* no taps */))
+			m[n] = true;
+			foreach(nn : nodes_around(graph, set<NodeNum>{n}, 2, true /* no taps */))
 				m[nn] = false;
 
-			std::ostringstream dotstream;
-			todot(ctx.graph, dotstream, m, code(ctx.view));
+			optional<pair<char, string>> layout; // view code, svg
 
-			string const
-				dot = dotstream.str(),
-				svg_filename = to_string(boost::hash_value(dot)) + ".svg",
-				svg_linkname = "neighbourhood" + to_string(ctx.n.index) + code(ctx.view) + ".svg";
+			foreach (v : views())
+			{
+				char const heading = code(v);
 
-			ctx.mkimg.store(svg_filename, svg_linkname, [&]
-				{
-					ctx.mkimg.make_svg(svg_filename, dot);
-				});
+				std::ostringstream dotstream;
+				todot(graph, dotstream, m, heading);
+				string const dot = dotstream.str();
+
+				string const filename = (ContentKey() << dot).str() + ".svg";
+
+				mkimg.store(filename, neighbourhood_linkname(n, heading), [&]
+					{
+						if (!layout) layout = make_pair(heading, mkimg.dot_to_svg(dot));
+
+						string const path = mkimg.res_dir + "/store/" + filename;
+						ofstream f(path);
+						f << retarget(layout->second, layout->first, heading);
+						if (!f.flush()) error("could not write " + path);
+					});
+			}
+		}
+
+		void write_page(Context const & ctx)
+		{
+			string const svg_linkname = neighbourhood_linkname(ctx.n, code(ctx.view));
 
 			std::ostringstream oss;
 			oss
@@ -642,32 +680,37 @@ namespace
 
 			string const
 				html = oss.str(),
-				html_filename = to_string(boost::hash_value(html)) + ".html",
+				html_filename = (ContentKey() << html).str() + ".html",
 				html_linkname = "p" + to_string(ctx.n.index) + code(ctx.view) + ".html";
 
 			ctx.mkimg.store(html_filename, html_linkname, [&]
 				{
-					ofstream f(ctx.mkimg.res_dir + "/store/" + html_filename);
+					string const path = ctx.mkimg.res_dir + "/store/" + html_filename;
+					ofstream f(path);
 					f << html;
+					if (!f.flush()) error("could not write " + path);
 				});
 		}
 
-		void write_it(ImageMaker & mkimg, Graph const & graph, NodeNum const n, string const image_url)
+		struct Transitions
 		{
-			set<NodeNum> nodes{n};
+			vector<Trans> incoming, outgoing;
+		};
+
+		void prepare_transitions(Build & b, NodeNum const n, Transitions & t)
+		{
+			Graph const & graph = b.graph;
 
 			auto const pos = graph[n].position;
 
 			PositionReorientation const reo = canonical_reorientation_with_mirror(pos);
 			assert(!reo.swap_players);
 
-			vector<Trans> incoming, outgoing;
-
 			size_t longest_in = 0, longest_out = 0;
 
 			foreach (step : graph[n].in)
 			{
-				auto v = frames_for_step(graph, step);
+				auto v = frames_for_step(graph, step, b.sequence_frames);
 
 				auto const this_side = to(step, graph);
 				auto const other_side = from(step, graph);
@@ -687,23 +730,20 @@ namespace
 				else if (bottom && sweep)
 				{ bottom = false; top = true; }
 
-				incoming.push_back({step, top, bottom, v, {}, *other_side});
+				t.incoming.push_back({step, top, bottom, v, {}, *other_side});
 
 				longest_in = std::max(longest_in, v.size());
 			}
 
-			foreach (trans : incoming)
+			foreach (trans : t.incoming)
 			{
 				auto const p = trans.frames.front();
 				trans.frames.insert(trans.frames.begin(), longest_in - trans.frames.size(), p);
-				trans.base_filename = transition_gifs(
-					mkimg, trans.frames, bg_color(trans),
-					to_string(n.index) + "in" + to_string(trans.step->index));
 			}
 
 			foreach (step : graph[n].out)
 			{
-				auto v = frames_for_step(graph, step);
+				auto v = frames_for_step(graph, step, b.sequence_frames);
 
 				auto const this_side = from(step, graph);
 				auto const other_side = to(step, graph);
@@ -713,39 +753,86 @@ namespace
 
 				auto const props = properties(graph[*step]);
 
-				outgoing.push_back({step, elem("top", props), elem("bottom", props), v, {}, *other_side});
+				t.outgoing.push_back({step, elem("top", props), elem("bottom", props), v, {}, *other_side});
 				longest_out = std::max(longest_out, v.size());
 			}
 
-			foreach (trans : outgoing)
+			foreach (trans : t.outgoing)
 			{
 				auto const p = trans.frames.back();
 				trans.frames.insert(trans.frames.end(), longest_out - trans.frames.size(), p);
-				trans.base_filename = transition_gifs(
-					mkimg, trans.frames, bg_color(trans),
-					to_string(n.index) + "out" + to_string(trans.step->index));
 			}
+		}
+
+		void order_transitions(vector<Trans> & v)
+		{
+			auto i = std::partition(v.begin(), v.end(),
+				[](Trans const & t) { return t.top; });
+
+			std::partition(i, v.end(),
+				[](Trans const & t) { return !t.bottom; });
+		}
+
+		void write_it(Build & b, NodeNum const n, string const image_url)
+			// Schedules: transitions -> their animations -> one page per view.
+		{
+			auto const t = std::make_shared<Transitions>();
 
-			auto order_transitions = [](vector<Trans> & v)
+			auto prepare = b.executor.spawn([&b, n, t]
 				{
-					auto i = std::partition(v.begin(), v.end(),
-						[](Trans const & t) { return t.top; });
+					if (keep_running) prepare_transitions(b, n, *t);
+				});
 
-					std::partition(i, v.end(),
-						[](Trans const & t) { return !t.bottom; });
-				};
+			vector<Executor::Task> animations;
+
+			for (size_t i = 0; i != b.graph[n].in.size(); ++i)
+				animations.push_back(b.executor.spawn([&b, n, t, i]
+					{
+						if (!keep_running) return;
+						Trans & trans = t->incoming[i];
+						trans.base_filename = transition_gifs(
+							b.mkimg, trans.frames, bg_color(trans),
+							to_string(n.index) + "in" + to_string(trans.step->index));
+					}, {prepare}));
+
+			for (size_t i = 0; i != b.graph[n].out.size(); ++i)
+				animations.push_back(b.executor.spawn([&b, n, t, i]
+					{
+						if (!keep_running) return;
+						Trans & trans = t->outgoing[i];
+						trans.base_filename = transition_gifs(
+							b.mkimg, trans.frames, bg_color(trans),
+							to_string(n.index) + "out" + to_string(trans.step->index));
+					}, {prepare}));
+
+			animations.push_back(prepare);
+
+			auto neighbourhood = b.executor.spawn([&b, n]
+				{
+					if (keep_running) write_neighbourhood(b.mkimg, b.graph, n);
+				});
 
-			order_transitions(incoming);
-			order_transitions(outgoing);
+			auto ordered = b.executor.spawn([t]
+				{
+					order_transitions(t->incoming);
+					order_transitions(t->outgoing);
+				}, animations);
+
+			vector<Executor::Task> pages;
 
 			foreach (v : views())
-			{
-				if (!keep_running) break;
+				pages.push_back(b.executor.spawn([&b, n, t, v, image_url]
+					{
+						if (!keep_running) return;
 
-				write_page(Context
-					{ mkimg, graph, n, incoming, outgoing
-					, v, image_url, query_for(graph, n) });
-			}
+						write_page(Context
+							{ b.mkimg, b.graph, n, t->incoming, t->outgoing
+							, v, image_url, query_for(b.graph, n) });
+					}, {ordered}));
+
+			pages.push_back(neighbourhood);
+
+			b.executor.spawn([&b]{ b.item_done(); }, pages);
 		}
 	}
 }
@@ -777,12 +864,17 @@ int main(int const argc, char const * const * const argv)
 
 		Graph const graph = loadGraph(config->db);
 
-		write_lists(graph, output_dir);
-		write_todo(graph, output_dir);
+		Executor executor(config->jobs);
 
 		ImageMaker mkimg(graph, output_dir + "/res/");
 
 		mkimg.no_anim = config->no_anim;
+		mkimg.png_frames = config->png_frames;
+		mkimg.renderer = config->renderer;
+		mkimg.svg = config->svg;
+
+		executor.spawn([&]{ write_lists(graph, output_dir); });
+		executor.spawn([&]{ write_todo(graph, output_dir); });
 
 		ofstream(output_dir + "/config.js")
 			<< "image_url='"
@@ -791,26 +883,55 @@ int main(int const argc, char const * const * const argv)
 					: "res/")
 			<< "';";
 
-		write_transition_gifs(mkimg, graph);
+		set<SeqNum> seqs;
+		set<NodeNum> nodes;
 
-		if (!keep_running) return 1;
+		if (config->since)
+		{
+			// Every position page shows its node's transitions and the
+			// neighbourhood up to two transitions away, so that is how far
+			// a change can reach.
+
+			Graph const old = loadGraph(*config->since);
+			DiffChanges c = changes(Differ(old, graph).diff, 2);
+			seqs = move(c.sequences);
+			nodes = move(c.nodes);
+		}
+		else
+		{
+			foreach (sn : seqnums(graph)) seqs.insert(sn);
+			foreach (n : nodenums(graph)) nodes.insert(n);
+		}
 
-		cout << "Writing " << graph.num_nodes() << " position pages...   0%";
+		Build b{executor, mkimg, graph};
+		b.items = seqs.size() + nodes.size();
 
-		foreach (n : nodenums(graph))
+		cout << "Writing " << seqs.size() << " * 8 standalone transition animations and "
+			<< nodes.size() << " position pages using " << executor.size() << " threads...   0%";
+
+		foreach (sn : seqs)
 		{
 			if (!keep_running) break;
+			write_transition_gifs(b, sn);
+		}
 
-			progress(n.index, graph.num_nodes());
+		foreach (n : nodes)
+		{
+			if (!keep_running) break;
 
-			position_page::write_it(mkimg, graph, n,
+			position_page::write_it(b, n,
 				config->image_url
 					? *(config->image_url)
 					: "../res/");
 		}
 
+		executor.wait();
+
 		cout << '\n';
 
+		if (config->gc && keep_running)
+			cout << "Removed " << mkimg.collect_garbage() << " unused files and links from store.\n";
+
 		return !keep_running;
 	}
 	catch (exception const & e)
@@ -3,6 +3,7 @@
 #include "md5.hpp"
 #include <fstream>
 #include <iterator>
+#include <deque>
 #include <cstring>
 #include <boost/algorithm/string/trim.hpp>
 
@@ -149,6 +150,345 @@ namespace
 		foreach (p : s.positions) o << p;
 		return o;
 	}
+
+	// Binary format: "GMDB", version, then nodes and edges. Integers are
+	// LEB128 varints (zigzagged if signed), reorientations raw doubles.
+	// Coordinates are in thousandths (offset by 2 for x and z), as in the
+	// text format, so decoding reproduces the exact same doubles.
+	//
+	// A joint is stored as the difference from where it would be if it had
+	// moved like its parent joint (toward the core) since the previous frame.
+	// Limbs moving along with the body then cost little.
+
+	//
+	// The chunked variant splits the same data into a head ("GMDH": nodes and
+	// transition metadata, with each transition's frame count and chunk) and
+	// chunks ("GMDC": the frames of a few nearby transitions each).
+
+	using Magic = char[4];
+
+	Magic const
+		binary_magic = {'G', 'M', 'D', 'B'},
+		head_magic = {'G', 'M', 'D', 'H'},
+		chunk_magic = {'G', 'M', 'D', 'C'};
+
+	unsigned const binary_version = 1;
+
+	using Quantized = array<array<int32_t, 3>, 2 * joint_count>;
+
+	size_t qindex(PlayerNum const p, Joint const j) { return p.index * joint_count + j; }
+
+	pair<Joint, Joint> const coding_order[joint_count] =
+		// each joint with its parent, parents first
+		{ {Core, Core}, {Neck, Core}, {Head, Neck}
+		, {LeftHip, Core}, {LeftKnee, LeftHip}, {LeftAnkle, LeftKnee}, {LeftHeel, LeftAnkle}, {LeftToe, LeftHeel}
+		, {RightHip, Core}, {RightKnee, RightHip}, {RightAnkle, RightKnee}, {RightHeel, RightAnkle}, {RightToe, RightHeel}
+		, {LeftShoulder, Neck}, {LeftElbow, LeftShoulder}, {LeftWrist, LeftElbow}, {LeftHand, LeftWrist}, {LeftFingers, LeftHand}
+		, {RightShoulder, Neck}, {RightElbow, RightShoulder}, {RightWrist, RightElbow}, {RightHand, RightWrist}, {RightFingers, RightHand} };
+
+	template<typename F>
+	void in_coding_order(Quantized & q, Quantized const * const prev, F code)
+		// code(value, prediction)
+	{
+		foreach (p : playerNums())
+		foreach (x : coding_order)
+		{
+			auto & v = q[qindex(p, x.first)];
+			auto const & parent = q[qindex(p, x.second)];
+
+			for (unsigned c = 0; c != 3; ++c)
+			{
+				int32_t prediction = prev ? (*prev)[qindex(p, x.first)][c] : 0;
+
+				if (x.first != x.second)
+					prediction += parent[c] - (prev ? (*prev)[qindex(p, x.second)][c] : 0);
+
+				code(v[c], prediction);
+			}
+		}
+	}
+
+	Quantized quantize(Position const & p)
+	{
+		Quantized q;
+
+		foreach (j : playerJoints)
+			q[qindex(j.player, j.joint)] =
+				{{ int32_t(std::round((p[j].x + 2) * 1000))
+				 , int32_t(std::round(p[j].y * 1000))
+				 , int32_t(std::round((p[j].z + 2) * 1000)) }};
+
+		return q;
+	}
+
+	Position dequantize(Quantized const & q)
+	{
+		Position p;
+
+		foreach (j : playerJoints)
+		{
+			auto const & v = q[qindex(j.player, j.joint)];
+			p[j] = {double(v[0]) / 1000 - 2, double(v[1]) / 1000, double(v[2]) / 1000 - 2};
+		}
+
+		return p;
+	}
+
+	class BinaryWriter
+	{
+		ostream & o;
+
+	public:
+
+		BinaryWriter(ostream & out, Magic const & magic): o(out)
+		{
+			o.write(magic, sizeof magic);
+			varint(binary_version);
+		}
+
+		void varint(uint64_t i)
+		{
+			for (; i >= 0x80; i >>= 7) o.put(char(0x80 | (i & 0x7f)));
+			o.put(char(i));
+		}
+
+		void zigzag(int64_t const i) { varint(uint64_t(i << 1) ^ uint64_t(i >> 63)); }
+
+		void raw(double const d) { o.write(reinterpret_cast<char const *>(&d), sizeof d); }
+
+		void lines(vector<string> const & v)
+		{
+			varint(v.size());
+			foreach (l : v) { varint(l.size()); o.write(l.data(), l.size()); }
+		}
+
+		void line_nr(optional<unsigned> const n) { varint(n ? *n + 1 : 0); }
+
+		void position(Position const & p, Quantized const * const prev, Quantized & q)
+			// leaves the quantized position in q, for the next frame
+		{
+			q = quantize(p);
+			in_coding_order(q, prev, [&](int32_t const v, int32_t const pred) { zigzag(v - pred); });
+		}
+
+		void node(ReorientedNode const & n)
+		{
+			PositionReorientation const & r = n.reorientation;
+			varint(n->index);
+			varint(r.swap_players | r.mirror << 1);
+			raw(r.reorientation.offset.x);
+			raw(r.reorientation.offset.y);
+			raw(r.reorientation.offset.z);
+			raw(r.reorientation.angle);
+		}
+
+		void nodes(Graph const & g)
+		{
+			varint(g.num_nodes());
+			foreach (n : nodenums(g))
+			{
+				lines(g[n].description);
+				line_nr(g[n].line_nr);
+
+				Quantized q;
+				position(g[n].position, nullptr, q);
+			}
+		}
+
+		void edge(Graph::Edge const & e)
+			// everything but the frames
+		{
+			lines(e.description);
+			line_nr(e.line_nr);
+			varint(e.detailed | e.bidirectional << 1);
+			node(e.from);
+			node(e.to);
+		}
+
+		void frames(vector<Position> const & v)
+		{
+			varint(v.size());
+
+			Quantized q[2];
+
+			for (size_t i = 0; i != v.size(); ++i)
+				position(v[i], i == 0 ? nullptr : &q[(i - 1) % 2], q[i % 2]);
+		}
+	};
+
+	class BinaryReader
+	{
+		char const * b, * const e;
+
+		void need(size_t const n) const { if (size_t(e - b) < n) error("truncated binary database"); }
+
+	public:
+
+		BinaryReader(char const * const begin, char const * const end, Magic const & magic)
+			: b(begin), e(end)
+		{
+			if (size_t(e - b) < sizeof magic || !std::equal(magic, magic + sizeof magic, b))
+				error("not a binary GrappleMap database (or not the expected part of one)");
+
+			b += sizeof magic;
+
+			if (varint() != binary_version) error("unsupported binary database version");
+		}
+
+		uint64_t varint()
+		{
+			uint64_t r = 0;
+			for (unsigned shift = 0; ; shift += 7)
+			{
+				need(1);
+				uint8_t const c = *b++;
+				r |= uint64_t(c & 0x7f) << shift;
+				if (!(c & 0x80)) return r;
+				if (shift > 56) error("corrupt binary database");
+			}
+		}
+
+		int64_t zigzag() { uint64_t const u = varint(); return int64_t(u >> 1) ^ -int64_t(u & 1); }
+
+		double raw()
+		{
+			double d;
+			need(sizeof d);
+			std::memcpy(&d, b, sizeof d);
+			b += sizeof d;
+			return d;
+		}
+
+		string bytes(size_t const n)
+		{
+			need(n);
+			string s(b, n);
+			b += n;
+			return s;
+		}
+
+		vector<string> lines()
+		{
+			vector<string> v(varint());
+			foreach (l : v) l = bytes(varint());
+			return v;
+		}
+
+		optional<unsigned> line_nr()
+		{
+			if (auto const n = varint()) return unsigned(n - 1);
+			return boost::none;
+		}
+
+		Position position(Quantized const * const prev, Quantized & q)
+		{
+			in_coding_order(q, prev, [&](int32_t & v, int32_t const pred) { v = pred + int32_t(zigzag()); });
+			return dequantize(q);
+		}
+
+		ReorientedNode node()
+		{
+			NodeNum const n{uint16_t(varint())};
+			auto const flags = varint();
+			PositionReorientation r;
+			r.swap_players = flags & 1;
+			r.mirror = flags & 2;
+			r.reorientation.offset.x = raw();
+			r.reorientation.offset.y = raw();
+			r.reorientation.offset.z = raw();
+			r.reorientation.angle = raw();
+			return n * r;
+		}
+
+		vector<NamedPosition> nodes()
+		{
+			vector<NamedPosition> v(varint());
+
+			foreach (n : v)
+			{
+				n.description = lines();
+				n.line_nr = line_nr();
+
+				Quantized q;
+				n.position = position(nullptr, q);
+			}
+
+			return v;
+		}
+
+		Graph::Edge edge()
+			// without frames
+		{
+			Sequence seq;
+			seq.description = lines();
+			seq.line_nr = line_nr();
+			auto const flags = varint();
+			seq.detailed = flags & 1;
+			seq.bidirectional = flags & 2;
+
+			ReorientedNode const from = node(), to = node();
+
+			return Graph::Edge(from, to, move(seq));
+		}
+
+		vector<Position> frames()
+		{
+			vector<Position> v(varint());
+			if (v.size() < 2) error("corrupt binary database");
+
+			Quantized q[2];
+
+			for (size_t i = 0; i != v.size(); ++i)
+				v[i] = position(i == 0 ? nullptr : &q[(i - 1) % 2], q[i % 2]);
+
+			return v;
+		}
+	};
+
+	vector<vector<SeqNum>> neighbourhood_chunks(Graph const & g, size_t const frames_per_chunk)
+		// Starting from the best connected nodes, repeatedly takes a node's
+		// neighbourhood's transitions until there are enough frames.
+	{
+		vector<NodeNum> nodes(nodenums(g).begin(), nodenums(g).end());
+
+		std::stable_sort(nodes.begin(), nodes.end(), [&](NodeNum a, NodeNum b)
+			{ return g[a].in_out.size() > g[b].in_out.size(); });
+
+		vector<bool> assigned(g.num_sequences(), false);
+		vector<vector<SeqNum>> chunks;
+
+		foreach (start : nodes)
+		{
+			vector<SeqNum> chunk;
+			size_t frames = 0;
+
+			std::deque<NodeNum> todo{start};
+			set<NodeNum> seen{start};
+
+			while (!todo.empty() && frames < frames_per_chunk)
+			{
+				NodeNum const n = todo.front();
+				todo.pop_front();
+
+				foreach (s : g[n].in_out)
+				{
+					NodeNum const other = *(s.reverse ? g[*s].from : g[*s].to);
+					if (seen.insert(other).second) todo.push_back(other);
+
+					if (assigned[s->index]) continue;
+
+					assigned[s->index] = true;
+					chunk.push_back(*s);
+					frames += g[*s].positions.size();
+				}
+			}
+
+			if (!chunk.empty()) chunks.push_back(move(chunk));
+		}
+
+		return chunks;
+	}
+
 }
 
 Graph loadGraph(char const * const b, char const * const e)
@@ -232,6 +572,145 @@ Graph loadGraph(string const filename)
 	return g;
 }
 
+void saveBinary(Graph const & g, std::ostream & o)
+{
+	BinaryWriter w(o, binary_magic);
+
+	w.nodes(g);
+
+	w.varint(g.num_sequences());
+	foreach (s : seqnums(g))
+	{
+		w.edge(g[s]);
+		w.frames(g[s].positions);
+	}
+}
+
+Graph loadBinaryGraph(char const * const b, char const * const e)
+{
+	BinaryReader r(b, e, binary_magic);
+
+	vector<NamedPosition> nodes = r.nodes();
+
+	vector<Graph::Edge> edges;
+
+	for (auto n = r.varint(); n != 0; --n)
+	{
+		edges.push_back(r.edge());
+		edges.back().positions = r.frames();
+	}
+
+	return Graph(move(nodes), move(edges));
+}
+
+Graph loadBinaryGraph(string const filename)
+{
+	std::ifstream ff(filename, std::ios::binary);
+
+	if (!ff) error(filename + ": " + std::strerror(errno));
+
+	std::istreambuf_iterator<char> i(ff), e;
+	std::string const db(i, e);
+
+	return loadBinaryGraph(db.data(), db.data() + db.size());
+}
+
+void saveChunked(Graph const & g, string const dir, size_t const frames_per_chunk)
+{
+	vector<vector<SeqNum>> const chunks = neighbourhood_chunks(g, frames_per_chunk);
+
+	vector<size_t> chunk_of(g.num_sequences());
+	for (size_t c = 0; c != chunks.size(); ++c)
+		foreach (s : chunks[c]) chunk_of[s.index] = c;
+
+	auto const write = [](string const & path, function<void(ostream &)> const & f)
+		{
+			std::ofstream o(path, std::ios::binary);
+			f(o);
+			o.close();
+			if (!o) error("could not write " + path);
+		};
+
+	write(dir + "/head.bin", [&](ostream & o)
+		{
+			BinaryWriter w(o, head_magic);
+
+			w.nodes(g);
+
+			w.varint(g.num_sequences());
+			foreach (s : seqnums(g))
+			{
+				w.edge(g[s]);
+				w.varint(g[s].positions.size());
+				w.varint(chunk_of[s.index]);
+			}
+
+			w.varint(chunks.size());
+		});
+
+	for (size_t c = 0; c != chunks.size(); ++c)
+		write(dir + "/frames" + to_string(c) + ".bin", [&](ostream & o)
+			{
+				BinaryWriter w(o, chunk_magic);
+
+				w.varint(chunks[c].size());
+				foreach (s : chunks[c])
+				{
+					w.varint(s.index);
+					w.frames(g[s].positions);
+				}
+			});
+}
+
+DatabaseHead loadDatabaseHead(char const * const b, char const * const e)
+{
+	BinaryReader r(b, e, head_magic);
+
+	vector<NamedPosition> nodes = r.nodes();
+
+	vector<Graph::Edge> edges;
+	vector<size_t> frame_count, chunk;
+
+	for (auto n = r.varint(); n != 0; --n)
+	{
+		edges.push_back(r.edge());
+		frame_count.push_back(r.varint());
+		chunk.push_back(r.varint());
+
+		// stand-in frames until the chunk arrives
+
+		Graph::Edge & edge = edges.back();
+		if (edge.from->index >= nodes.size() || edge.to->index >= nodes.size())
+			error("transition endpoint out of range");
+
+		edge.positions =
+			{ edge.from.reorientation(nodes[edge.from->index].position)
+			, edge.to.reorientation(nodes[edge.to->index].position) };
+	}
+
+	size_t const chunk_count = r.varint();
+
+	return DatabaseHead{Graph(move(nodes), move(edges)), move(frame_count), move(chunk), chunk_count};
+}
+
+vector<pair<SeqNum, vector<Position>>> loadDatabaseChunk(
+	char const * const b, char const * const e, size_t const num_sequences)
+{
+	BinaryReader r(b, e, chunk_magic);
+
+	vector<pair<SeqNum, vector<Position>>> v(r.varint());
+
+	foreach (x : v)
+	{
+		uint64_t const s = r.varint();
+		if (s >= num_sequences) error("chunk sequence out of range");
+		x.first = SeqNum{uint32_t(s)};
+		x.second = r.frames();
+	}
+
+	return v;
+}
+
 void save(Graph const & g, string const filename)
 {
 	std::ofstream f(filename, std::ios::binary);
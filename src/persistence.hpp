@@ -9,6 +9,35 @@ namespace GrappleMap
 	Graph loadGraph(string filename);
 	void save(Graph const &, string filename);
 	void save(Graph const &, std::ostream &);
+
+	// The binary format is for shipping a database to clients (like the
+	// web pages) that only read it: node positions and transition endpoints
+	// are already resolved, and positions are stored quantized and delta-coded
+	// exactly as precise as in the text format.
+
+	void saveBinary(Graph const &, std::ostream &);
+	Graph loadBinaryGraph(char const * b, char const * e);
+	Graph loadBinaryGraph(string filename);
+
+	// The same, split into a head with everything but the frames, and
+	// chunks with the frames of a neighbourhood's transitions each, so
+	// that clients can show positions before all frames have arrived.
+
+	void saveChunked(Graph const &, string dir, size_t frames_per_chunk = 500);
+		// writes dir/head.bin and dir/frames0.bin, dir/frames1.bin, ...,
+		// ordered from the best to the least connected neighbourhood
+
+	struct DatabaseHead
+	{
+		Graph graph;
+			// Until their chunk is loaded, transitions only have their end frames.
+		vector<size_t> frame_count, chunk; // by SeqNum
+		size_t chunk_count;
+	};
+
+	DatabaseHead loadDatabaseHead(char const * b, char const * e);
+	vector<pair<SeqNum, vector<Position>>> loadDatabaseChunk(char const * b, char const * e, size_t num_sequences);
+		// num_sequences: of the head the chunk goes with
 	Path readScene(Graph const &, string filename);
 	void todot(Graph const &, std::ostream &, std::map<NodeNum, bool /* highlight */> const &, char heading);
 }
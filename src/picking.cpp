@@ -0,0 +1,75 @@
+#include "picking.hpp"
+#include <limits>
+
+namespace GrappleMap
+{
+	void world2xy(Camera const & camera, Position const & p, ScreenPosition & out)
+	{
+		foreach (n : playerNums())
+			world2xy(camera, p[n].data(), p[n].size(), out[n].data());
+	}
+
+	void world2xy(Camera const & camera, vector<Position> const & frames, vector<ScreenPosition> & out)
+	{
+		out.resize(frames.size());
+
+		for (size_t i = 0; i != frames.size(); ++i)
+			world2xy(camera, frames[i], out[i]);
+	}
+
+	double whereBetween(V2 const v, V2 const w, V2 const p)
+	{
+		V2 const
+			a = p - v,
+			b = w - v;
+
+		return std::max(0., std::min(1., inner_prod(a, b) / norm2(b) / norm2(b)));
+	}
+
+	PlayerJoint Picker::closest_joint(Camera const & camera, Position const & p, V2 const cursor)
+	{
+		world2xy(camera, p, joints);
+
+		return *minimal(playerJoints.begin(), playerJoints.end(),
+			[&](PlayerJoint const j) { return distanceSquared(joints[j], cursor); });
+	}
+
+	optional<Reoriented<Location>> Picker::next_location(
+		Graph const & graph, PlayerJoint const j,
+		vector<Reoriented<SegmentInSequence>> const & candidates,
+		Camera const & camera, V2 const cursor)
+	{
+		ends.clear();
+		foreach (c : candidates)
+		{
+			ends.push_back(at(from(c), j, graph));
+			ends.push_back(at(to(c), j, graph));
+		}
+
+		ends_xy.resize(ends.size());
+		world2xy(camera, ends.data(), ends.size(), ends_xy.data());
+
+		size_t best_candidate = candidates.size();
+		double best_howfar = 0, best_score = std::numeric_limits<double>::infinity();
+
+		for (size_t i = 0; i != candidates.size(); ++i)
+		{
+			V2 const v = ends_xy[i * 2], w = ends_xy[i * 2 + 1];
+
+			double const howfar = whereBetween(v, w, cursor);
+			double const score = distanceSquared(v + (w - v) * howfar, cursor);
+
+			if (score < best_score)
+			{
+				best_candidate = i;
+				best_howfar = howfar;
+				best_score = score;
+			}
+		}
+
+		if (best_candidate == candidates.size()) return none; // no candidates, or none on screen
+
+		Reoriented<SegmentInSequence> const & c = candidates[best_candidate];
+		return Reoriented<Location>{Location{*c, best_howfar}, c.reorientation};
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef GRAPPLEMAP_PICKING_HPP
+#define GRAPPLEMAP_PICKING_HPP
+
+#include "camera.hpp"
+#include "graph_util.hpp"
+
+namespace GrappleMap
+{
+	using ScreenPosition = PerPlayerJoint<V2>;
+
+	void world2xy(Camera const &, Position const &, ScreenPosition &);
+	void world2xy(Camera const &, vector<Position> const &, vector<ScreenPosition> &);
+		// The output is resized, not reallocated, so it can be reused.
+
+	double whereBetween(V2 v, V2 w, V2 p);
+		// how far along the segment from v to w the point nearest to p is, in [0, 1]
+
+	class Picker
+		// What the cursor points at, for the editors. Keeps its buffers
+		// across calls, so that picking does not allocate once warmed up.
+	{
+		ScreenPosition joints;
+		vector<V3> ends; // from and to of each candidate
+		vector<V2> ends_xy;
+
+	public:
+
+		PlayerJoint closest_joint(Camera const &, Position const &, V2 cursor);
+
+		optional<Reoriented<Location>> next_location(
+			Graph const &, PlayerJoint,
+			vector<Reoriented<SegmentInSequence>> const & candidates,
+			Camera const &, V2 cursor);
+				// The location along the candidates at which the joint
+				// is nearest to the cursor on screen.
+	};
+}
+
+#endif
@@ -165,6 +165,13 @@ void SphereDrawer::draw(V3 center, double radius, bool const fine, F out) const
 	}
 }
 
+std::vector<BasicVertex> SphereDrawer::unitMesh(bool const fine) const
+{
+	std::vector<BasicVertex> r;
+	draw({0, 0, 0}, 1, fine, [&r](V3f pos, V3f norm){ r.push_back({pos, norm, {}}); });
+	return r;
+}
+
 #ifndef EMSCRIPTEN
 void drawSphere(SphereDrawer const & d, V3 center, double radius, bool const fine)
 {
@@ -192,6 +199,25 @@ void drawSphere(SphereDrawer const & sd, V4f color, V3 center, double radius, bo
 }
 
 #ifndef EMSCRIPTEN
+void drawVertices(std::vector<BasicVertex> const & v)
+{
+	if (v.empty()) return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+
+	glVertexPointer(3, GL_FLOAT, sizeof(BasicVertex), &v[0].pos);
+	glNormalPointer(GL_FLOAT, sizeof(BasicVertex), &v[0].norm);
+	glColorPointer(4, GL_FLOAT, sizeof(BasicVertex), &v[0].color);
+
+	glDrawArrays(GL_TRIANGLES, 0, v.size());
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
 void PlayerDrawer::drawPillar(V3 from, V3 to, double from_radius, double to_radius) const
 {
 	V3 a = normalize(cross(to - from, V3{1,1,1} - from));
@@ -246,6 +272,32 @@ void PlayerDrawer::drawPillar(V3 color, V3 from, V3 to, double from_radius, doub
 		[&out, color](V3f pos, V3f norm){ out.push_back({pos, norm, V4f(color, 1)}); });
 }
 
+std::vector<BasicVertex> PlayerDrawer::unitPillar() const
+{
+	std::vector<BasicVertex> r;
+
+	auto out = [&](unsigned const i, float const z)
+		{
+			V3f const v{float(angles[i].first), float(angles[i].second), 0};
+			r.push_back({{v.x, v.y, z}, v, {}});
+		};
+
+	// same order as drawPillar
+
+	for (unsigned i = 0; i != faces; ++i)
+	{
+		out(i, 0);
+		out(i, 1);
+		out(i + 1, 0);
+
+		out(i + 1, 0);
+		out(i, 1);
+		out(i + 1, 1);
+	}
+
+	return r;
+}
+
 #ifndef EMSCRIPTEN
 void PlayerDrawer::drawJoints(Position const & pos,
 	PerPlayerJoint<optional<V3>> const & colors,
@@ -302,6 +354,39 @@ void PlayerDrawer::drawJoints(Position const & pos,
 	}
 }
 
+void PlayerDrawer::drawJoints(Position const & pos,
+	PerPlayerJoint<optional<V3>> const & colors,
+	optional<PlayerNum> const first_person_player,
+	PlayerInstances & out) const
+{
+	foreach (pj : playerJoints)
+	{
+		if (pj.player == first_person_player && pj.joint == Head) continue;
+
+		auto color = colors[pj];
+
+		double extraBig = 0;
+
+		V3 cc = playerDefs[pj.player].color;
+
+		if (color)
+		{
+			extraBig = 0.005;
+			cc = *color;
+		}
+
+		bool const fine =
+			pj.joint == Head || pj.joint == Core ||
+			pj.joint == RightHip || pj.joint == LeftHip ||
+			pj.joint == RightShoulder || pj.joint == LeftShoulder;
+
+		float const radius = jointDefs[pj.joint].radius + extraBig;
+
+		(fine ? out.fine_spheres : out.coarse_spheres).push_back(
+			{to_f(pos[pj]), to_f(pos[pj]), radius, radius, V4f(to_f(cc), 1)});
+	}
+}
+
 #ifndef EMSCRIPTEN
 void PlayerDrawer::drawLimbs(Position const & pos, optional<PlayerNum> const first_person_player) const
 {
@@ -359,6 +444,38 @@ void PlayerDrawer::drawLimbs(Position const & pos, optional<PlayerNum> const fir
 	}
 }
 
+void PlayerDrawer::drawLimbs(Position const & pos, optional<PlayerNum> const first_person_player,
+	PlayerInstances & out) const
+{
+	foreach (p : playerNums())
+	{
+		V4f const color(to_f(playerDefs[p].color), 1);
+		Player const & player = pos[p];
+
+		auto pillar = [&](V3 const from, V3 const to, double const from_radius, double const to_radius)
+			{
+				out.pillars.push_back({to_f(from), to_f(to), float(from_radius), float(to_radius), color});
+			};
+
+		foreach (l : limbs())
+			if (l.visible)
+			{
+				auto const a = l.ends[0], b = l.ends[1];
+
+				if (b == Head && p == first_person_player) continue;
+
+				if (l.midpointRadius)
+				{
+					auto mid = (player[a] + player[b]) / 2.;
+					pillar(player[a], mid, jointDefs[a].radius, *l.midpointRadius);
+					pillar(mid, player[b], *l.midpointRadius, jointDefs[b].radius);
+				}
+				else
+					pillar(player[a], player[b], jointDefs[a].radius, jointDefs[b].radius);
+			}
+	}
+}
+
 #ifndef EMSCRIPTEN
 void PlayerDrawer::drawPlayers(Position const & pos,
 	PerPlayerJoint<optional<V3>> const & colors,
@@ -389,4 +506,18 @@ void PlayerDrawer::drawPlayers(Position const & pos,
 	fatTriangle(pos, RightAnkle, RightHeel, RightToe, out);
 }
 
+void PlayerDrawer::drawPlayers(Position const & pos,
+	PerPlayerJoint<optional<V3>> const & colors,
+	optional<PlayerNum> const first_person_player, PlayerInstances & out) const
+{
+	drawLimbs(pos, first_person_player, out);
+
+	drawJoints(pos, colors, first_person_player, out);
+	fatTriangle(pos, LeftHip, Core, RightHip, out.triangles);
+	fatTriangle(pos, LeftShoulder, Neck, RightShoulder, out.triangles);
+	fatTriangle(pos, LeftShoulder, Core, RightShoulder, out.triangles);
+	fatTriangle(pos, LeftAnkle, LeftHeel, LeftToe, out.triangles);
+	fatTriangle(pos, RightAnkle, RightHeel, RightToe, out.triangles);
+}
+
 }
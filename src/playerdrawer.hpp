@@ -12,6 +12,32 @@ namespace GrappleMap
 		V4f color;
 	};
 
+	struct ShapeInstance
+		// A sphere (centered at 'from', of radius from_radius) or a tapered
+		// pillar, to be drawn by stretching one of the unit meshes below
+		// in the vertex shader.
+	{
+		V3f from, to;
+		float from_radius, to_radius;
+		V4f color;
+	};
+
+	struct PlayerInstances
+		// What drawPlayers makes for instanced rendering: about 90 small
+		// records per pair of players instead of tens of thousands of vertices.
+	{
+		std::vector<ShapeInstance> fine_spheres, coarse_spheres, pillars;
+		std::vector<BasicVertex> triangles; // the torso and feet, as plain vertices
+
+		void clear()
+		{
+			fine_spheres.clear();
+			coarse_spheres.clear();
+			pillars.clear();
+			triangles.clear();
+		}
+	};
+
 	class SphereDrawer
 	{
 		icosphere::IndexedMesh const fine_icomesh, course_icomesh;
@@ -22,11 +48,16 @@ namespace GrappleMap
 
 			template<typename F>
 			void draw(V3 center, double radius, bool fine, F out) const;
+
+			std::vector<BasicVertex> unitMesh(bool fine) const;
+				// for ShapeInstance spheres; colors are not set
 	};
 
 	void drawSphere(SphereDrawer const &, V3 center, double radius, bool fine = true);
 	void drawSphere(SphereDrawer const &, V4f color, V3 center, double radius, bool fine, std::vector<BasicVertex> & out);
 
+	void drawVertices(std::vector<BasicVertex> const &); // as triangles, using client-side arrays
+
 	class PlayerDrawer
 	{
 		static constexpr unsigned faces = 10;
@@ -47,6 +78,11 @@ namespace GrappleMap
 			PerPlayerJoint<optional<V3>> const & colors,
 			optional<PlayerNum> first_person_player,
 			std::vector<BasicVertex> & out) const;
+		void drawLimbs(Position const &, optional<PlayerNum> first_person_player, PlayerInstances &) const;
+		void drawJoints(Position const &,
+			PerPlayerJoint<optional<V3>> const & colors,
+			optional<PlayerNum> first_person_player,
+			PlayerInstances &) const;
 
 	public:
 
@@ -62,6 +98,16 @@ namespace GrappleMap
 			PerPlayerJoint<optional<V3>> const & colors,
 			optional<PlayerNum> first_person_player,
 			std::vector<BasicVertex> & out) const;
+
+		void drawPlayers(Position const &,
+			PerPlayerJoint<optional<V3>> const & colors,
+			optional<PlayerNum> first_person_player,
+			PlayerInstances &) const;
+
+		std::vector<BasicVertex> unitPillar() const;
+			// For ShapeInstance pillars: x and y are the factors for the two
+			// axes perpendicular to the pillar (as chosen by drawPillar), and
+			// z goes from 0 at 'from' to 1 at 'to'. Colors are not set.
 	};
 }
 
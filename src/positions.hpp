@@ -95,6 +95,19 @@ struct PositionReorientation
 	}
 };
 
+inline bool operator==(PositionReorientation const & a, PositionReorientation const & b)
+{
+	return a.reorientation.offset == b.reorientation.offset
+		&& a.reorientation.angle == b.reorientation.angle
+		&& a.swap_players == b.swap_players
+		&& a.mirror == b.mirror;
+}
+
+inline bool operator!=(PositionReorientation const & a, PositionReorientation const & b)
+{
+	return !(a == b);
+}
+
 inline ostream & operator<<(ostream & o, PositionReorientation const & r)
 {
 	return o
@@ -0,0 +1,93 @@
+// Prepended to libgrapplemap-queries.js (see SConstruct). The graph lives on a
+// pthread of its own (see web_queries.cpp), so none of these block the caller;
+// each returns a promise of the query's result.
+//
+// Works in browsers (served with the cross-origin isolation headers that
+// SharedArrayBuffer needs) as well as under node:
+//
+//   var gm = require('./libgrapplemap-queries.js');
+//   gm.queries.open(fs.readFileSync('../GrappleMap.bin'))
+//     .then(function() { return gm.queries.path(64); })
+//     .then(function(steps) { console.log(steps); });
+
+Module.queries = (function()
+{
+	var next_id = 0;
+	var pending = {}; // by id
+
+	var ready = new Promise(function(resolve)
+		{
+			var prev = Module.onRuntimeInitialized;
+			Module.onRuntimeInitialized = function()
+				{
+					if (prev) prev();
+					resolve();
+				};
+		});
+
+	function request(f)
+	{
+		return ready.then(function()
+			{
+				return new Promise(function(resolve, reject)
+					{
+						var id = next_id++;
+						pending[id] = { resolve: resolve, reject: reject };
+						f(id);
+					});
+			});
+	}
+
+	return {
+		settle: function(id, json)
+			// called by the query thread, via the main thread's event loop
+		{
+			var p = pending[id];
+			delete pending[id];
+
+			var r = JSON.parse(json);
+			if (r.error !== undefined) p.reject(new Error(r.error));
+			else p.resolve(r.result);
+		},
+
+		open: function(bytes)
+			// bytes of GrappleMap.bin; resolves to {nodes, transitions} counts
+		{
+			return request(function(id) { Module.queryOpen(id, bytes); });
+		},
+
+		openHead: function(bytes)
+			// bytes of a chunked database's head.bin (see streamDB in gm.js)
+		{
+			return request(function(id) { Module.queryOpenHead(id, bytes); });
+		},
+
+		search: function(tags, substrs)
+			// tags as search.js's selected_tags: [tag, include] pairs;
+			// resolves to {nodes, transitions} ids
+		{
+			return request(function(id) { Module.querySearch(id, tags, substrs || []); });
+		},
+
+		path: function(min_frames, seed)
+			// resolves to steps, as random_path in gm.js
+		{
+			if (seed === undefined) seed = Math.floor(Math.random() * 4294967296);
+			return request(function(id) { Module.queryPath(id, min_frames, seed); });
+		},
+
+		neighbourhood: function(nodes, depth)
+			// resolves to the ids of the nodes within depth of nodes,
+			// excluding nodes themselves
+		{
+			return request(function(id) { Module.queryNeighbourhood(id, nodes, depth || 1); });
+		},
+
+		grow: function(start, within)
+			// resolves to the ids of the nodes in within that are connected
+			// to start through nodes in within, as grow in gm.js
+		{
+			return request(function(id) { Module.queryGrow(id, start, within); });
+		}
+	};
+})();
@@ -0,0 +1,96 @@
+#include "persistence.hpp"
+#include "query_engine.hpp"
+#include "js_conversions.hpp"
+#include <boost/program_options.hpp>
+#include <fstream>
+
+using namespace GrappleMap;
+
+namespace
+{
+	struct Config
+	{
+		string db;
+		string query;
+		vector<string> substrs;
+		optional<string> each_tag;
+	};
+
+	optional<Config> config_from_args(int const argc, char const * const * const argv)
+	{
+		namespace po = boost::program_options;
+
+		po::options_description desc("options");
+		desc.add_options()
+			("help,h",
+				"show this help")
+			("db",
+				po::value<string>()->default_value("GrappleMap.txt"),
+				"database file")
+			("query",
+				po::value<string>()->default_value(""),
+				"tags to include, and to exclude if prefixed with '-', separated by commas")
+			("substr",
+				po::value<vector<string>>()->multitoken(),
+				"substrings of descriptions or tags that results must have")
+			("each_tag",
+				po::value<string>(),
+				"instead, write the result for each single tag to <dir>/<tag>.json");
+
+		po::positional_options_description posopts;
+		posopts.add("query", 1);
+
+		po::variables_map vm;
+		po::store(po::command_line_parser(argc, argv).options(desc).positional(posopts).run(), vm);
+		po::notify(vm);
+
+		if (vm.count("help"))
+		{
+			cout << desc <<
+				"\nPrints, as JSON, what search.js shows for index.html?<query>: "
+				"the matching node and transition ids, and the refinements on offer.\n";
+
+			return none;
+		}
+
+		Config c{vm["db"].as<string>(), vm["query"].as<string>(), {}, none};
+
+		if (vm.count("substr")) c.substrs = vm["substr"].as<vector<string>>();
+		if (vm.count("each_tag")) c.each_tag = vm["each_tag"].as<string>();
+
+		return c;
+	}
+}
+
+int main(int const argc, char const * const * const argv)
+{
+	try
+	{
+		optional<Config> const config = config_from_args(argc, argv);
+		if (!config) return 0;
+
+		Graph const graph = loadGraph(config->db);
+		QueryEngine const engine(graph);
+
+		if (!config->each_tag)
+		{
+			tojson(engine(parse_tag_query(config->query), config->substrs), cout);
+			cout << '\n';
+			return 0;
+		}
+
+		foreach (t : engine.tags())
+		{
+			string const path = *config->each_tag + '/' + t + ".json";
+			std::ofstream f(path);
+			tojson(engine(TagQuery{{t, true}}, config->substrs), f);
+			f << '\n';
+			if (!f) error("could not write " + path);
+		}
+	}
+	catch (std::exception const & e)
+	{
+		cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,212 @@
+#include "query_engine.hpp"
+
+namespace GrappleMap
+{
+	namespace
+	{
+		using Bits = vector<uint64_t>;
+
+		Bits make_bits(size_t const n, bool const value)
+		{
+			Bits b((n + 63) / 64, value ? ~uint64_t(0) : 0);
+			if (value && n % 64 != 0) b.back() = (uint64_t(1) << (n % 64)) - 1;
+			return b;
+		}
+
+		bool test(Bits const & b, size_t const i) { return (b[i / 64] >> (i % 64)) & 1; }
+		void set_bit(Bits & b, size_t const i) { b[i / 64] |= uint64_t(1) << (i % 64); }
+
+		size_t popcount(uint64_t const x) { return __builtin_popcountll(x); }
+
+		size_t count_and(Bits const & a, Bits const & b)
+		{
+			size_t n = 0;
+			for (size_t i = 0; i != a.size(); ++i) n += popcount(a[i] & b[i]);
+			return n;
+		}
+
+		template<typename F>
+		void each_bit(Bits const & b, F f)
+		{
+			for (size_t i = 0; i != b.size(); ++i)
+				for (uint64_t w = b[i]; w != 0; w &= w - 1)
+					f(i * 64 + __builtin_ctzll(w));
+		}
+
+		uint32_t trigram(char const * p)
+		{
+			return uint32_t(uint8_t(p[0])) << 16 | uint32_t(uint8_t(p[1])) << 8 | uint8_t(p[2]);
+		}
+
+		string lowercase(string s)
+		{
+			foreach (c : s) if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+			return s;
+		}
+	}
+
+	void QueryEngine::Index::add_text(vector<string> const & desc, set<string> const & tags)
+	{
+		uint32_t const i = text.size();
+
+		string t;
+		foreach (l : desc) t += lowercase(l) + '\n';
+		foreach (l : tags) t += lowercase(l) + '\n';
+
+		if (!desc.empty() || !tags.empty()) set_bit(has_text, i);
+
+		std::set<uint32_t> grams;
+		for (size_t j = 0; j + 3 <= t.size(); ++j)
+			if (t[j] != '\n' && t[j + 1] != '\n' && t[j + 2] != '\n')
+				grams.insert(trigram(&t[j]));
+
+		foreach (g : grams) trigrams[g].push_back(i);
+			// indices are added in increasing order, so the lists stay sorted
+
+		text.push_back(std::move(t));
+	}
+
+	QueryEngine::Bits QueryEngine::Index::select(TagQuery const & q,
+		std::map<string, size_t> const & tag_ids, vector<string> const & substrs) const
+	{
+		Bits r = make_bits(size, true);
+
+		foreach (e : q)
+		{
+			auto const i = tag_ids.find(e.first);
+
+			if (i == tag_ids.end())
+			{
+				if (e.second) return make_bits(size, false);
+				continue;
+			}
+
+			Bits const & b = tagged[i->second];
+			for (size_t w = 0; w != r.size(); ++w)
+				r[w] &= e.second ? b[w] : ~b[w];
+		}
+
+		foreach (s : substrs)
+		{
+			if (s.empty())
+			{
+				for (size_t w = 0; w != r.size(); ++w) r[w] &= has_text[w];
+				continue;
+			}
+
+			Bits m = make_bits(size, false);
+
+			auto const check = [&](size_t const i)
+				{
+					if (test(r, i) && text[i].find(s) != string::npos) set_bit(m, i);
+				};
+
+			if (s.size() < 3) each_bit(r, check);
+			else
+			{
+				// Candidates are in the posting lists of all of s's trigrams.
+				// Start with the shortest and check the rest with the text itself.
+
+				vector<uint32_t> const * shortest = nullptr;
+
+				for (size_t j = 0; j + 3 <= s.size(); ++j)
+				{
+					auto const p = trigrams.find(trigram(&s[j]));
+					if (p == trigrams.end()) return make_bits(size, false);
+					if (!shortest || p->second.size() < shortest->size()) shortest = &p->second;
+				}
+
+				foreach (i : *shortest) check(i);
+			}
+
+			r = std::move(m);
+		}
+
+		return r;
+	}
+
+	QueryEngine::QueryEngine(Graph const & g)
+	{
+		foreach (t : GrappleMap::tags(g))
+		{
+			tag_ids[t] = tag_names.size();
+			tag_names.push_back(t);
+		}
+
+		nodes.size = g.num_nodes();
+		transitions.size = g.num_sequences();
+
+		nodes.tagged.assign(tag_names.size(), make_bits(nodes.size, false));
+		transitions.tagged.assign(tag_names.size(), make_bits(transitions.size, false));
+		nodes.has_text = make_bits(nodes.size, false);
+		transitions.has_text = make_bits(transitions.size, false);
+
+		foreach (n : nodenums(g))
+		{
+			set<string> const tt = GrappleMap::tags(g[n]);
+			foreach (t : tt) set_bit(nodes.tagged[tag_ids[t]], n.index);
+			nodes.add_text(g[n].description, tt);
+		}
+
+		foreach (s : seqnums(g))
+		{
+			set<string> const tt = GrappleMap::tags(g[s]);
+
+			for (size_t t = 0; t != tag_names.size(); ++t)
+				if (test(nodes.tagged[t], g[s].from->index) && test(nodes.tagged[t], g[s].to->index))
+					set_bit(transitions.tagged[t], s.index);
+
+			foreach (t : tt) set_bit(transitions.tagged[tag_ids[t]], s.index);
+			transitions.add_text(g[s].description, tt);
+		}
+	}
+
+	QueryResult QueryEngine::operator()(TagQuery const & q, vector<string> const & substrs) const
+	{
+		vector<string> ss;
+		foreach (s : substrs) ss.push_back(lowercase(s));
+
+		Bits const n = nodes.select(q, tag_ids, ss);
+		Bits const t = transitions.select(q, tag_ids, ss);
+
+		QueryResult r;
+
+		each_bit(n, [&](size_t const i){ r.nodes.push_back(NodeNum{uint16_t(i)}); });
+		each_bit(t, [&](size_t const i){ r.transitions.push_back(SeqNum{uint32_t(i)}); });
+
+		for (size_t tag = 0; tag != tag_names.size(); ++tag)
+		{
+			size_t const ni = count_and(n, nodes.tagged[tag]);
+			size_t const ti = count_and(t, transitions.tagged[tag]);
+
+			Refinement const x{tag_names[tag], ni, r.nodes.size() - ni, ti, r.transitions.size() - ti};
+
+			if ((x.nodes_in != 0 && x.nodes_out != 0) || (x.trans_in != 0 && x.trans_out != 0))
+				r.refinements.push_back(x);
+		}
+
+		return r;
+	}
+
+	TagQuery parse_tag_query(string const & s)
+	{
+		TagQuery q;
+
+		size_t i = 0;
+		while (i < s.size())
+		{
+			size_t const j = std::min(s.find(',', i), s.size());
+			string const t = s.substr(i, j - i);
+
+			if (!t.empty())
+			{
+				if (t[0] == '-') q.emplace(t.substr(1), false);
+				else q.emplace(t, true);
+			}
+
+			i = j + 1;
+		}
+
+		return q;
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef GRAPPLEMAP_QUERY_ENGINE_HPP
+#define GRAPPLEMAP_QUERY_ENGINE_HPP
+
+#include "metadata.hpp"
+#include <unordered_map>
+
+namespace GrappleMap
+{
+	struct Refinement
+	{
+		string tag;
+		size_t nodes_in, nodes_out, trans_in, trans_out;
+			// among the results, how many have the tag and how many do not
+	};
+
+	struct QueryResult
+	{
+		vector<NodeNum> nodes;
+		vector<SeqNum> transitions;
+		vector<Refinement> refinements;
+			// in tag order, for those tags that would split
+			// the resulting nodes or transitions
+	};
+
+	class QueryEngine
+		// Evaluates search.js's queries (tags to include and exclude, and
+		// substrings of description lines and tags) without looking at
+		// every node and transition: tags are interned as bitsets, and
+		// texts are indexed by the trigrams they contain.
+	{
+		using Bits = vector<uint64_t>;
+
+		struct Index
+			// for either the nodes or the transitions
+		{
+			size_t size = 0;
+			vector<Bits> tagged; // by tag id
+			vector<string> text;
+				// by node/transition: lowercased description lines and tags, one per line
+			Bits has_text;
+			std::unordered_map<uint32_t, vector<uint32_t>> trigrams;
+				// sorted node/transition indices by trigram
+
+			void add_text(vector<string> const & desc, set<string> const & tags);
+			Bits select(TagQuery const &, std::map<string, size_t> const & tag_ids,
+				vector<string> const & substrs) const;
+		};
+
+		vector<string> tag_names; // sorted
+		std::map<string, size_t> tag_ids;
+		Index nodes, transitions;
+
+	public:
+
+		explicit QueryEngine(Graph const &);
+
+		QueryResult operator()(TagQuery const &, vector<string> const & substrs = {}) const;
+			// Substrings are matched case-insensitively (ASCII only).
+			// Like trans_is_selected in search.js, a transition counts as
+			// tagged if both its ends are.
+
+		vector<string> const & tags() const { return tag_names; }
+	};
+
+	TagQuery parse_tag_query(string const &);
+		// as in index.html's query string, e.g. "top,-mount"
+}
+
+#endif
@@ -0,0 +1,437 @@
+#include "raycast.hpp"
+#include "camera.hpp"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace GrappleMap {
+
+namespace
+{
+	double const infinity = std::numeric_limits<double>::infinity();
+
+	struct Hit
+	{
+		double t = infinity;
+		V3 normal, color;
+	};
+
+	struct Bounds { V3 center; double radius; };
+
+	struct Sphere
+	{
+		V3 center;
+		double radius;
+		V3 color;
+
+		Bounds bounds() const { return {center, radius}; }
+
+		void intersect(V3 const o, V3 const d, Hit & hit) const
+		{
+			V3 const oc = o - center;
+			double const
+				b = inner_prod(oc, d),
+				h = b*b - inner_prod(oc, oc) + radius*radius;
+
+			if (h < 0) return;
+
+			double const t = -b - std::sqrt(h);
+
+			if (t > 0 && t < hit.t)
+				hit = {t, (oc + d * t) / radius, color};
+		}
+	};
+
+	struct RoundCone
+		// Cone between spheres at a and b, with radii ra and rb.
+	{
+		V3 a, b;
+		double ra, rb;
+		V3 color;
+
+		Bounds bounds() const
+		{
+			return {between(a, b), distance(a, b) / 2 + std::max(ra, rb)};
+		}
+
+		void intersect(V3 const o, V3 const d, Hit & hit) const
+		{
+			V3 const ba = b - a, oa = o - a, ob = o - b;
+
+			double const
+				rr = ra - rb,
+				m0 = inner_prod(ba, ba),
+				m1 = inner_prod(ba, oa),
+				m2 = inner_prod(ba, d),
+				m3 = inner_prod(d, oa),
+				m5 = inner_prod(oa, oa),
+				m6 = inner_prod(ob, d),
+				m7 = inner_prod(ob, ob),
+				d2 = m0 - rr*rr,
+				k2 = d2 - m2*m2,
+				k1 = d2*m3 - m1*m2 + m2*rr*ra,
+				k0 = d2*m5 - m1*m1 + m1*rr*ra*2 - m0*ra*ra,
+				h = k1*k1 - k0*k2;
+
+			if (h < 0) return;
+
+			// body
+
+			double t = (-std::sqrt(h) - k1) / k2;
+			double const y = m1 - ra*rr + t*m2;
+
+			if (y > 0 && y < d2)
+			{
+				if (t > 0 && t < hit.t)
+					hit = {t, normalize((oa + d * t) * d2 - ba * y), color};
+				return;
+			}
+
+			// caps
+
+			double const
+				h1 = m3*m3 - m5 + ra*ra,
+				h2 = m6*m6 - m7 + rb*rb;
+
+			if (h1 > 0)
+			{
+				t = -m3 - std::sqrt(h1);
+				if (t > 0 && t < hit.t) hit = {t, (oa + d * t) / ra, color};
+			}
+
+			if (h2 > 0)
+			{
+				t = -m6 - std::sqrt(h2);
+				if (t > 0 && t < hit.t) hit = {t, (ob + d * t) / rb, color};
+			}
+		}
+	};
+
+	struct Triangle
+	{
+		V3 a, b, c, normal, color;
+
+		Bounds bounds() const
+		{
+			V3 const m = (a + b + c) / 3.;
+			return {m, std::sqrt(std::max({distanceSquared(m, a), distanceSquared(m, b), distanceSquared(m, c)}))};
+		}
+
+		void intersect(V3 const o, V3 const d, Hit & hit) const
+		{
+			V3 const e1 = b - a, e2 = c - a, p = cross(d, e2);
+			double const det = inner_prod(e1, p);
+
+			if (std::abs(det) < 1e-12) return;
+
+			V3 const s = o - a;
+			double const u = inner_prod(s, p) / det;
+			if (u < 0 || u > 1) return;
+
+			V3 const q = cross(s, e1);
+			double const v = inner_prod(d, q) / det;
+			if (v < 0 || u + v > 1) return;
+
+			double const t = inner_prod(e2, q) / det;
+			if (t > 0 && t < hit.t) hit = {t, normal, color};
+		}
+	};
+
+	struct Scene
+	{
+		vector<Sphere> spheres;
+		vector<RoundCone> cones;
+		vector<Triangle> triangles;
+	};
+
+	void fatTriangle(Scene & s, V3 const color, V3 const a, double const ar, V3 const b, double const br, V3 const c, double const cr)
+		// Same shape as the one in playerdrawer.cpp, made of two faces and three cones.
+	{
+		V3 const fwd = normalize(cross(b - a, c - a));
+
+		s.triangles.push_back({a + fwd * ar, b + fwd * br, c + fwd * cr, fwd, color});
+		s.triangles.push_back({a - fwd * ar, c - fwd * cr, b - fwd * br, -fwd, color});
+		s.cones.push_back({a, b, ar, br, color});
+		s.cones.push_back({b, c, br, cr, color});
+		s.cones.push_back({c, a, cr, ar, color});
+	}
+
+	Scene scene(Position const & pos, optional<PlayerNum> const first_person)
+		// Mirrors PlayerDrawer::drawPlayers.
+	{
+		Scene s;
+
+		foreach (pj : playerJoints)
+			if (!(pj.player == first_person && pj.joint == Head))
+				s.spheres.push_back({pos[pj], jointDefs[pj.joint].radius, playerDefs[pj.player].color});
+
+		foreach (p : playerNums())
+		{
+			V3 const color = playerDefs[p].color;
+			Player const & player = pos[p];
+
+			foreach (l : limbs())
+			{
+				if (!l.visible) continue;
+
+				auto const a = l.ends[0], b = l.ends[1];
+
+				if (b == Head && p == first_person) continue;
+
+				if (l.midpointRadius)
+				{
+					auto const mid = between(player[a], player[b]);
+					s.cones.push_back({player[a], mid, jointDefs[a].radius, *l.midpointRadius, color});
+					s.cones.push_back({mid, player[b], *l.midpointRadius, jointDefs[b].radius, color});
+				}
+				else
+					s.cones.push_back({player[a], player[b], jointDefs[a].radius, jointDefs[b].radius, color});
+			}
+
+			auto tri = [&](Joint const x, Joint const y, Joint const z)
+				{
+					fatTriangle(s, color,
+						player[x], jointDefs[x].radius,
+						player[y], jointDefs[y].radius,
+						player[z], jointDefs[z].radius);
+				};
+
+			tri(LeftHip, Core, RightHip);
+			tri(LeftShoulder, Neck, RightShoulder);
+			tri(LeftShoulder, Core, RightShoulder);
+			tri(LeftAnkle, LeftHeel, LeftToe);
+			tri(RightAnkle, RightHeel, RightToe);
+		}
+
+		return s;
+	}
+
+	struct Eye
+		// Camera as an origin and basis, with the projection's scale factors.
+	{
+		V3 position, right, up, forward;
+		double sx, sy; // ndc per unit of (lateral offset / depth)
+		double x0, y0, w, h; // view rectangle in pixels, y up
+
+		V2 project(V3 const p, double & depth) const // to pixels, y up
+		{
+			V3 const d = p - position;
+			depth = inner_prod(d, forward);
+			return
+				{ x0 + (sx * inner_prod(d, right) / depth + 1) / 2 * w
+				, y0 + (sy * inner_prod(d, up) / depth + 1) / 2 * h };
+		}
+
+		V3 ray(double const px, double const py) const // through pixel coordinates, y up
+		{
+			return normalize(forward
+				+ right * (((px - x0) / w * 2 - 1) / sx)
+				+ up * (((py - y0) / h * 2 - 1) / sy));
+		}
+	};
+
+	Eye eye(View const & v, Position const & pos, Camera camera, unsigned const width, unsigned const height)
+	{
+		Eye e;
+		e.x0 = v.x * width;
+		e.y0 = v.y * height;
+		e.w = int(v.w * width);
+		e.h = int(v.h * height);
+
+		camera.setViewportSize(v.fov, e.w, e.h);
+		M const & proj = camera.projection();
+		e.sx = proj[0];
+		e.sy = proj[5];
+
+		if (v.first_person)
+		{
+			// as gluLookAt in renderBasic
+
+			auto const & p = pos[*v.first_person];
+			e.position = p[Head];
+			e.forward = normalize(between(p[LeftHand], p[RightHand]) - p[Head]);
+			e.right = normalize(cross(e.forward, p[Head] - p[Neck]));
+			e.up = cross(e.right, e.forward);
+		}
+		else
+		{
+			M const & mv = camera.model_view();
+			e.right = {mv[0], mv[4], mv[8]};
+			e.up = {mv[1], mv[5], mv[9]};
+			e.forward = -V3{mv[2], mv[6], mv[10]};
+			e.position = (e.right * mv[12] + e.up * mv[13] - e.forward * mv[14]) * -1.;
+		}
+
+		return e;
+	}
+
+	V3 shade(V3 const color, V3 const normal)
+		// GL fixed-function lighting as set up by setupLights:
+		// default global ambient, two directional lights.
+	{
+		static V3 const
+			l0 = normalize(V3{2, 2, 2}),
+			l1 = normalize(V3{-2, 2, -2});
+
+		double const f = 0.2 + 2 * 0.03
+			+ 0.65 * (std::max(0., inner_prod(normal, l0)) + std::max(0., inner_prod(normal, l1)));
+
+		return color * f;
+	}
+
+	struct Segment { V2 a, b; };
+
+	double distanceSquared(V2 const p, Segment const & s)
+	{
+		V2 const ab = s.b - s.a;
+		double const l = inner_prod(ab, ab);
+		double const u = l == 0 ? 0 : std::min(1., std::max(0., inner_prod(p - s.a, ab) / l));
+		return GrappleMap::distanceSquared(p, s.a + ab * u);
+	}
+
+	vector<Segment> grid_segments(Eye const & e, unsigned const size)
+		// The grid's lines projected to the screen, clipped to the near plane.
+	{
+		vector<Segment> r;
+		double const near = 0.01;
+
+		auto add = [&](V3 a, V3 b)
+			{
+				double da, db;
+				e.project(a, da);
+				e.project(b, db);
+
+				if (da < near && db < near) return;
+				if (da < near) a = a + (b - a) * ((near - da) / (db - da));
+				if (db < near) b = b + (a - b) * ((near - db) / (da - db));
+
+				r.push_back({e.project(a, da), e.project(b, db)});
+			};
+
+		for (double i = size*-2.; i <= size*2.; ++i)
+		{
+			add(V3{i/2, 0, size*-1.}, V3{i/2, 0, size*1.});
+			add(V3{size*-1., 0, i/2}, V3{size*1., 0, i/2});
+		}
+
+		return r;
+	}
+
+	template<typename P>
+	void cull(vector<P> const & prims, Eye const & e,
+		double const x0, double const y0, double const x1, double const y1,
+		vector<P const *> & out)
+		// Keeps those whose projected bounding circle may overlap the tile.
+	{
+		out.clear();
+
+		foreach (p : prims)
+		{
+			Bounds const b = p.bounds();
+			double depth;
+			V2 const c = e.project(b.center, depth);
+
+			if (depth - b.radius > 0.01)
+			{
+				double const r = b.radius * std::max(e.sx * e.w, e.sy * e.h) / 2 / (depth - b.radius) + 1;
+				if (c.x + r < x0 || c.x - r > x1 || c.y + r < y0 || c.y - r > y1) continue;
+			}
+
+			out.push_back(&p);
+		}
+	}
+}
+
+void RayCaster::render(
+	View const & v, Position const & pos, Camera const camera,
+	unsigned const width, unsigned const height,
+	std::uint8_t * const out) const
+{
+	Eye const e = eye(v, pos, camera, width, height);
+	Scene const s = scene(pos, v.first_person);
+	vector<Segment> const grid = grid_segments(e, grid_size);
+
+	V3 const grid_shade = shade(grid_color, V3{0, 1, 0});
+	double const half_line = grid_line_width / 2;
+
+	unsigned const tile = 16,
+		tiles_x = (unsigned(e.w) + tile - 1) / tile,
+		tiles_y = (unsigned(e.h) + tile - 1) / tile;
+
+	std::atomic<unsigned> next_tile{0};
+
+	auto work = [&]
+		{
+			vector<Sphere const *> spheres;
+			vector<RoundCone const *> cones;
+			vector<Triangle const *> triangles;
+			vector<Segment const *> lines;
+
+			for (unsigned t; (t = next_tile++) < tiles_x * tiles_y; )
+			{
+				unsigned const
+					tx0 = e.x0 + (t % tiles_x) * tile,
+					ty0 = e.y0 + (t / tiles_x) * tile,
+					tx1 = std::min(unsigned(e.x0 + e.w), tx0 + tile),
+					ty1 = std::min(unsigned(e.y0 + e.h), ty0 + tile);
+
+				cull(s.spheres, e, tx0, ty0, tx1, ty1, spheres);
+				cull(s.cones, e, tx0, ty0, tx1, ty1, cones);
+				cull(s.triangles, e, tx0, ty0, tx1, ty1, triangles);
+
+				lines.clear();
+				foreach (l : grid)
+					if (std::max(l.a.x, l.b.x) + half_line + 1 >= tx0 && std::min(l.a.x, l.b.x) - half_line - 1 <= tx1 &&
+					    std::max(l.a.y, l.b.y) + half_line + 1 >= ty0 && std::min(l.a.y, l.b.y) - half_line - 1 <= ty1)
+						lines.push_back(&l);
+
+				for (unsigned py = ty0; py != ty1; ++py)
+				for (unsigned px = tx0; px != tx1; ++px)
+				{
+					V3 sum{0, 0, 0};
+
+					for (unsigned sy = 0; sy != samples; ++sy)
+					for (unsigned sx = 0; sx != samples; ++sx)
+					{
+						V2 const p{px + (sx + .5) / samples, py + (sy + .5) / samples};
+						V3 const d = e.ray(p.x, p.y);
+
+						Hit hit;
+						foreach (x : spheres) x->intersect(e.position, d, hit);
+						foreach (x : cones) x->intersect(e.position, d, hit);
+						foreach (x : triangles) x->intersect(e.position, d, hit);
+
+						double const ground = d.y < 0 ? -e.position.y / d.y : infinity;
+
+						bool on_line = false;
+						if (ground < hit.t)
+							foreach (l : lines)
+								if (distanceSquared(p, *l) <= half_line * half_line)
+								{
+									on_line = true;
+									break;
+								}
+
+						if (on_line) sum += grid_shade;
+						else if (hit.t != infinity) sum += shade(hit.color, hit.normal);
+						else sum += background_color;
+					}
+
+					sum = sum / double(samples * samples);
+
+					std::uint8_t * const o = out + ((height - 1 - py) * width + px) * 3;
+					o[0] = std::min(255., sum.x * 255 + .5);
+					o[1] = std::min(255., sum.y * 255 + .5);
+					o[2] = std::min(255., sum.z * 255 + .5);
+				}
+			}
+		};
+
+	vector<std::thread> helpers;
+	for (unsigned i = 1; i < threads; ++i) helpers.emplace_back(work);
+	work();
+	foreach (h : helpers) h.join();
+}
+
+}
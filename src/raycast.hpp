@@ -0,0 +1,35 @@
+#ifndef GRAPPLEMAP_RAYCAST_HPP
+#define GRAPPLEMAP_RAYCAST_HPP
+
+#include "positions.hpp"
+#include "rendering.hpp"
+#include <cstdint>
+
+namespace GrappleMap
+{
+	class Camera;
+
+	struct RayCaster
+		// Renders players and the ground grid without GL, by casting rays
+		// against spheres (joints), round cones (limbs) and thick triangles
+		// (torso, feet), lit like the fixed-function path in rendering.cpp.
+		// The image is cut into tiles, each only testing the primitives
+		// whose screen-space bounds overlap it.
+	{
+		V3 background_color {0, 0, 0};
+		V3 grid_color {.5, .5, .5};
+		unsigned grid_size = 2;
+		double grid_line_width = 1; // in output pixels
+		unsigned samples = 3; // per pixel, per axis, for antialiasing
+		unsigned threads = 1;
+
+		void render(
+			View const &, Position const &, Camera,
+			unsigned width, unsigned height,
+			std::uint8_t * out) const;
+			// out: width*height RGB pixels, top row first.
+			// Only the part covered by the view is written.
+	};
+}
+
+#endif
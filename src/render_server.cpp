@@ -0,0 +1,355 @@
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+	// see https://www.robertnitsch.de/notes/cpp/cpp11_boost_filesystem_undefined_reference_copy_file
+
+#include "persistence.hpp"
+#include "thumbnails.hpp"
+#include "tasks.hpp"
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <iostream>
+#include <regex>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace GrappleMap;
+
+namespace
+{
+	struct Config
+	{
+		string db;
+		string cache_dir;
+		unsigned port;
+		optional<string> socket;
+		unsigned jobs;
+		size_t memory_cache_mb;
+		ImageMaker::Renderer renderer;
+		bool svg;
+	};
+
+	optional<Config> config_from_args(int const argc, char const * const * const argv)
+	{
+		namespace po = boost::program_options;
+
+		po::options_description desc("Options");
+		desc.add_options()
+			("help,h",
+				"show this help")
+			("db",
+				po::value<string>()->default_value("GrappleMap.txt"),
+				"database file")
+			("cache_dir",
+				po::value<string>()->default_value("./render-cache"),
+				"disk cache, laid out like mkpospages' res directory")
+			("port",
+				po::value<unsigned>()->default_value(8080),
+				"TCP port to listen on (on 127.0.0.1 only)")
+			("socket",
+				po::value<string>(),
+				"listen on this Unix socket instead of TCP")
+			("jobs,j",
+				po::value<unsigned>()->default_value(Executor::default_threads()),
+				"number of worker threads (and render contexts)")
+			("memory_cache",
+				po::value<size_t>()->default_value(256),
+				"size of the in-memory cache, in megabytes")
+			("renderer",
+				po::value<string>()->default_value("osmesa"),
+				"osmesa or raycast")
+			("svg",
+				po::value<bool>()->default_value(false),
+				"serve SVG instead of PNG and MP4 images");
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help"))
+		{
+			cout << desc <<
+				"\nServes the images that grapplemap-mkpospages would write to res/, "
+				"e.g. /p123n480x360.png, /t55200x150n.mp4 or /t55n.mp4, "
+				"rendering them when first requested.\n";
+
+			return none;
+		}
+
+		string const renderer = vm["renderer"].as<string>();
+
+		if (renderer != "osmesa" && renderer != "raycast")
+			error("unknown renderer: " + renderer);
+
+		optional<string> socket;
+		if (vm.count("socket")) socket = vm["socket"].as<string>();
+
+		return Config
+			{ vm["db"].as<string>()
+			, vm["cache_dir"].as<string>()
+			, vm["port"].as<unsigned>()
+			, socket
+			, vm["jobs"].as<unsigned>()
+			, vm["memory_cache"].as<size_t>()
+			, renderer == "raycast" ? ImageMaker::Renderer::raycast : ImageMaker::Renderer::osmesa
+			, vm["svg"].as<bool>() };
+	}
+
+	using Bytes = std::shared_ptr<string const>;
+
+	Bytes read_file(string const & path)
+	{
+		std::ifstream f(path, std::ios::binary);
+		if (!f) error("could not read " + path);
+		std::istreambuf_iterator<char> i(f), e;
+		return std::make_shared<string const>(i, e);
+	}
+
+	string content_type(string const & name)
+	{
+		auto ends_with = [&](string const & s)
+			{ return name.size() >= s.size() && name.compare(name.size() - s.size(), s.size(), s) == 0; };
+
+		if (ends_with(".png")) return "image/png";
+		if (ends_with(".mp4")) return "video/mp4";
+		if (ends_with(".svg")) return "image/svg+xml";
+		return "application/octet-stream";
+	}
+
+	optional<ImageView> view_for_code(char const c)
+	{
+		foreach (v : views())
+			if (code(v) == c) return v;
+
+		return none;
+	}
+
+	class Server
+	{
+		Graph const & graph;
+		ImageMaker & mkimg;
+		Memo<string, Bytes> cache;
+			// Keyed by link name. Concurrent requests for the same image
+			// wait for the same rendering.
+
+		struct Image
+		{
+			string linkname;
+			function<void()> make;
+		};
+
+		optional<Image> image(string const & name) const
+			// Maps the requested name to the link name under which
+			// mkpospages would have stored it, and how to make it.
+		{
+			static std::regex const
+				still("p(\\d{1,5})([a-zA-Z])(\\d{1,4})x(\\d{1,4})(\\.\\w+)"),
+				transition("t(\\d{1,6})(200x150)?([a-zA-Z])(\\.\\w+)");
+
+			std::smatch m;
+
+			if (std::regex_match(name, m, still))
+			{
+				NodeNum const n{uint16_t(std::stoul(m[1]))};
+				optional<ImageView> const view = view_for_code(m.str(2)[0]);
+				unsigned const w = std::stoul(m[3]), h = std::stoul(m[4]);
+
+				if (n.index >= graph.num_nodes() || !view || w == 0 || h == 0 || w > 1920 || h > 1080
+					|| m[5] != mkimg.still_ext(*view))
+					return none;
+
+				return Image
+					{ 'p' + to_string(n.index) + code(*view) + to_string(w) + 'x' + to_string(h) + m.str(5)
+					, [this, n, view, w, h]{ position_image(mkimg, graph, n, *view, w, h); } };
+			}
+
+			if (std::regex_match(name, m, transition))
+			{
+				SeqNum const s{std::stoul(m[1])};
+				optional<ImageView> const view = view_for_code(m.str(3)[0]);
+
+				if (s.index >= graph.num_sequences() || !view || m[4] != mkimg.anim_ext())
+					return none;
+
+				return Image
+					{ 't' + to_string(s.index) + "200x150" + code(*view) + m.str(4)
+					, [this, s, view]
+						{
+							transition_gif(mkimg, transition_frames(graph, s), *view,
+								bg_color(graph, s), 't' + to_string(s.index));
+						} };
+			}
+
+			return none;
+		}
+
+		static void send_all(int const fd, char const * data, size_t size)
+		{
+			while (size != 0)
+			{
+				ssize_t const n = ::send(fd, data, size, MSG_NOSIGNAL);
+				if (n <= 0) return; // client went away
+				data += n;
+				size -= n;
+			}
+		}
+
+		static void respond(int const fd, string const & status, string const & type, string const & body, bool const head)
+		{
+			string const header
+				= "HTTP/1.0 " + status + "\r\n"
+				+ "Content-Type: " + type + "\r\n"
+				+ "Content-Length: " + to_string(body.size()) + "\r\n"
+				+ "Connection: close\r\n\r\n";
+
+			send_all(fd, header.data(), header.size());
+			if (!head) send_all(fd, body.data(), body.size());
+		}
+
+	public:
+
+		Server(Graph const & g, ImageMaker & m, size_t const memory_cache_bytes)
+			: graph(g), mkimg(m)
+			, cache(memory_cache_bytes, [](Bytes const & b){ return b->size(); })
+		{}
+
+		void handle(int const fd)
+		{
+			string request;
+			char buf[4096];
+
+			while (request.find("\r\n\r\n") == string::npos && request.size() < 8192)
+			{
+				ssize_t const n = ::recv(fd, buf, sizeof buf, 0);
+				if (n <= 0) break;
+				request.append(buf, n);
+			}
+
+			string const line = request.substr(0, request.find("\r\n"));
+
+			std::smatch m;
+			static std::regex const request_line("(GET|HEAD) /([^ ?]*)[^ ]* HTTP/1\\.[01]");
+
+			if (!std::regex_match(line, m, request_line))
+			{
+				respond(fd, "400 Bad Request", "text/plain", "bad request\n", false);
+				return;
+			}
+
+			bool const head = m[1] == "HEAD";
+			string const name = m[2];
+
+			optional<Image> const img = image(name);
+
+			if (!img)
+			{
+				respond(fd, "404 Not Found", "text/plain", "no such image: " + name + '\n', head);
+				return;
+			}
+
+			try
+			{
+				Bytes const bytes = cache(img->linkname, [&]
+					{
+						img->make();
+						return read_file(mkimg.res_dir + "/" + img->linkname);
+					});
+
+				respond(fd, "200 OK", content_type(img->linkname), *bytes, head);
+			}
+			catch (std::exception const & e)
+			{
+				cerr << "error: " << name << ": " << e.what() << '\n';
+				respond(fd, "500 Internal Server Error", "text/plain", string(e.what()) + '\n', head);
+			}
+		}
+	};
+
+	int listen_socket(Config const & config)
+	{
+		int fd;
+
+		if (config.socket)
+		{
+			sockaddr_un addr{};
+			addr.sun_family = AF_UNIX;
+			if (config.socket->size() >= sizeof addr.sun_path) error("socket path too long");
+			std::copy(config.socket->begin(), config.socket->end(), addr.sun_path);
+
+			unlink(config.socket->c_str());
+
+			fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0 || bind(fd, reinterpret_cast<sockaddr const *>(&addr), sizeof addr) != 0)
+				error("could not bind to " + *config.socket);
+		}
+		else
+		{
+			sockaddr_in addr{};
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons(config.port);
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+			fd = socket(AF_INET, SOCK_STREAM, 0);
+			int const one = 1;
+			if (fd < 0
+				|| setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one) != 0
+				|| bind(fd, reinterpret_cast<sockaddr const *>(&addr), sizeof addr) != 0)
+				error("could not bind to port " + to_string(config.port));
+		}
+
+		if (listen(fd, 64) != 0) error("listen failed");
+
+		return fd;
+	}
+}
+
+int main(int const argc, char const * const * const argv)
+{
+	try
+	{
+		optional<Config> const config = config_from_args(argc, argv);
+		if (!config) return 0;
+
+		boost::filesystem::create_directories(config->cache_dir + "/store");
+
+		Graph const graph = loadGraph(config->db);
+
+		ImageMaker mkimg(graph, config->cache_dir);
+		mkimg.renderer = config->renderer;
+		mkimg.svg = config->svg;
+
+		Server server(graph, mkimg, config->memory_cache_mb << 20);
+
+		Executor executor(config->jobs);
+			// Each worker renders in its own context, which it keeps.
+
+		int const listener = listen_socket(*config);
+
+		cout << "Listening on "
+			<< (config->socket ? *config->socket : "http://127.0.0.1:" + to_string(config->port) + '/')
+			<< " with " << executor.size() << " threads.\n";
+
+		for (;;)
+		{
+			int const fd = accept(listener, nullptr, nullptr);
+			if (fd < 0) { perror("accept"); continue; }
+
+			timeval const timeout{10, 0};
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+				// so that idle clients do not hold on to workers
+
+			executor.spawn([&server, fd]
+				{
+					server.handle(fd);
+					close(fd);
+				});
+				// blocks while too many requests are queued
+		}
+	}
+	catch (exception const & e)
+	{
+		cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
+}
@@ -10,6 +10,14 @@ namespace GrappleMap {
 
 namespace
 {
+	void grid(Style const & style)
+	{
+		if (style.grid_lists)
+			style.grid_lists->draw(style.grid_color, style.grid_size, style.grid_line_width);
+		else
+			GrappleMap::grid(style.grid_color, style.grid_size, style.grid_line_width);
+	}
+
 	#ifndef EMSCRIPTEN
 	void glNormal(V3 const & v) { ::glNormal3d(v.x, v.y, v.z); }
 	void glVertex(V3 const & v) { ::glVertex3d(v.x, v.y, v.z); }
@@ -53,52 +61,38 @@ namespace
 	}
 
 	#ifndef EMSCRIPTEN
-	void drawSelection(
-		Graph const & g, OrientedPath const & path, PlayerJoint const j,
-		optional<SegmentInSequence> const current_segment,
-		Camera const * const camera, Style const & style)
+	void drawOverlay(Overlay const & o, Camera const * const camera, Style const & style)
 	{
 		glNormal3d(0, 1, 0);
 		glDisable(GL_DEPTH_TEST);
 		glLineWidth(4);
 
-		glColor4f(1, 1, 1, 0.6);
-
-		foreach (seq : path)
+		foreach (strip : o.strips)
 		{
 			glBegin(GL_LINE_STRIP);
-				foreach (p : positions(forget_direction(seq), g))
-				{
-				
-					if (current_segment && to(*current_segment) == *p)
-						glBegin(GL_LINE_STRIP);
-
-					glVertex(at(p, j, g));
-
-					if (current_segment && from(*current_segment) == *p)
-						glEnd();
-				}
+			foreach (v : strip)
+			{
+				glColor4f(v.second.x, v.second.y, v.second.z, v.second.w);
+				glVertex(v.first);
+			}
 			glEnd();
 		}
+
 		#ifdef USE_FTGL
 		if (camera && !style.font.Error())
-			foreach (seq : path)
-				foreach (p : positions(forget_direction(seq), g))
-					renderText(
-						style.font,
-						world2screen(*camera, at(p, j, g)),
-						to_string(p->position.index + 1), white);
+			foreach (m : o.marks)
+				renderText(style.font, world2screen(*camera, m.first), m.second, white);
 		else
 		#endif
 		{
+			glColor4f(1, 1, 1, 0.6);
 			glPointSize(10);
 			glBegin(GL_POINTS);
-			foreach (seq : path)
-				foreach (v : joint_positions(forget_direction(seq), j, g))
-//				if (p.index != 0 && i.index != seq.positions.size() - 1)
-					glVertex(v);
+			foreach (m : o.marks) glVertex(m.first);
 			glEnd();
 		}
+
+		glEnable(GL_DEPTH_TEST);
 	}
 	#endif
 
@@ -137,59 +131,6 @@ namespace
 		}
 	}
 
-	#ifndef EMSCRIPTEN
-	void drawViables(
-		Graph const & graph, vector<Viable> const & viables,
-		OrientedPath const & selection,
-		optional<SegmentInSequence> const current_segment,
-		Style const &)
-	{
-		glNormal3d(0, 1, 0);
-		glDisable(GL_DEPTH_TEST);
-		glLineWidth(4);
-
-		foreach (v : viables)
-		{
-			if (elem(*v.sequence, selection))
-			{
-				if (current_segment && current_segment->sequence == *v.sequence)
-				{
-					glColor4f(0, 1, 0, 0.8);
-					glBegin(GL_LINES);
-						glVertex(at(v.sequence * from(current_segment->segment), v.joint, graph));
-						glVertex(at(v.sequence * to(current_segment->segment), v.joint, graph));
-					glEnd();
-				}
-			}
-			else
-			{
-				glBegin(GL_LINE_STRIP);
-
-				foreach (i : PosNum::range(v.begin, v.end))
-				{
-					glColor4f(1, 1, 0, std::max(0.0, 0.3 - v.depth(i) * 0.05));
-					glVertex(at(v.sequence * i, v.joint, graph));
-				}
-				glEnd();
-			}
-/*
-			if (selected) glColor4f(1, 1, 1, 0.6);
-			else glColor4f(1, 1, 0, 0.3);
-
-			glPointSize(20);
-			glBegin(GL_POINTS);
-			if (v.begin.index == 0)
-				glVertex(apply(r, seq.positions.front(), j));
-			if (v.end.index == seq.positions.size())
-				glVertex(apply(r, seq.positions.back(), j));
-			glEnd();
-*/
-		}
-
-		glEnable(GL_DEPTH_TEST);
-	}
-	#endif
-
 	void drawViables(
 		Graph const & graph, vector<Viable> const & viables,
 		OrientedPath const & selection,
@@ -262,6 +203,21 @@ void grid(V3 const color, unsigned const size, unsigned const line_width)
 		}
 	glEnd();
 }
+
+void GridLists::draw(V3 const color, unsigned const size, unsigned const line_width)
+{
+	unsigned & list = lists[std::make_tuple(color.x, color.y, color.z, size, line_width)];
+
+	if (list == 0)
+	{
+		list = glGenLists(1);
+		glNewList(list, GL_COMPILE);
+		grid(color, size, line_width);
+		glEndList();
+	}
+
+	glCallList(list);
+}
 #endif
 
 void grid(V3f const col, unsigned const size, vector<BasicVertex> & out)
@@ -308,6 +264,60 @@ Style::Style()
 	}
 #endif
 
+namespace
+{
+	void setupView(
+		View const & v,
+		Position const & position,
+		Camera camera,
+		int const left, int const bottom,
+		int const width, int const height,
+		Style const & style)
+	{
+		glEnable(GL_SCISSOR_TEST);
+		glEnable(GL_POINT_SMOOTH);
+
+		int
+			x = left + v.x * width,
+			y = bottom + v.y * height,
+			w = v.w * width,
+			h = v.h * height;
+
+		glViewport(x, y, w, h);
+		glScissor(x, y, w, h);
+
+		camera.setViewportSize(v.fov, w, h);
+
+		glClearColor(style.background_color.x, style.background_color.y, style.background_color.z, 0);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		glEnable(GL_COLOR_MATERIAL);
+
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixd(camera.projection().data());
+
+		glMatrixMode(GL_MODELVIEW);
+
+		if (v.first_person)
+		{
+			auto const & p = position[*v.first_person];
+
+			glLoadIdentity();
+			gluLookAt(p[Head], (p[LeftHand] + p[RightHand]) / 2., p[Head] - p[Neck]);
+		}
+		else
+			glLoadMatrixd(camera.model_view().data());
+
+		setupLights();
+
+		glEnable(GL_DEPTH);
+		glEnable(GL_DEPTH_TEST);
+
+		grid(style);
+	}
+}
+
 void renderBasic(
 	View const & v,
 	Position const & position,
@@ -318,63 +328,84 @@ void renderBasic(
 	Style const & style,
 	PlayerDrawer const & playerDrawer)
 {
-	glEnable(GL_SCISSOR_TEST);
-	glEnable(GL_POINT_SMOOTH);
-
-	int
-		x = left + v.x * width,
-		y = bottom + v.y * height,
-		w = v.w * width,
-		h = v.h * height;
+	setupView(v, position, camera, left, bottom, width, height, style);
 
-	glViewport(x, y, w, h);
-	glScissor(x, y, w, h);
+	playerDrawer.drawPlayers(position, colors, v.first_person);
+}
 
-	camera.setViewportSize(v.fov, w, h);
+#ifndef EMSCRIPTEN
+void renderBasic(
+	View const & v,
+	Position const & position,
+	vector<BasicVertex> const & players,
+	Camera camera,
+	int const left, int const bottom,
+	int const width, int const height,
+	Style const & style)
+{
+	setupView(v, position, camera, left, bottom, width, height, style);
 
-	glClearColor(style.background_color.x, style.background_color.y, style.background_color.z, 0);
+	drawVertices(players);
+}
+#endif
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void addSelection(
+	Overlay & o, Graph const & g, OrientedPath const & path, PlayerJoint const j,
+	optional<SegmentInSequence> const current_segment)
+{
+	foreach (seq : path)
+	{
+		o.strips.emplace_back();
 
-	glEnable(GL_COLOR_MATERIAL);
+		foreach (p : positions(forget_direction(seq), g))
+		{
+			if (current_segment && to(*current_segment) == *p)
+				o.strips.emplace_back(); // leave the current segment out
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadMatrixd(camera.projection().data());
+			V3 const v = at(p, j, g);
 
-	glMatrixMode(GL_MODELVIEW);
+			o.strips.back().emplace_back(v, V4f{1, 1, 1, 0.6f});
+			o.marks.emplace_back(v, to_string(p->position.index + 1));
+		}
+	}
+}
 
-	if (v.first_person)
+void addViables(
+	Overlay & o, Graph const & graph, vector<Viable> const & viables,
+	OrientedPath const & selection,
+	optional<SegmentInSequence> const current_segment)
+{
+	foreach (v : viables)
 	{
-		auto const & p = position[*v.first_person];
+		if (elem(*v.sequence, selection))
+		{
+			if (current_segment && current_segment->sequence == *v.sequence)
+				o.strips.push_back(
+					{ {at(v.sequence * from(current_segment->segment), v.joint, graph), V4f{0, 1, 0, 0.8f}}
+					, {at(v.sequence * to(current_segment->segment), v.joint, graph), V4f{0, 1, 0, 0.8f}} });
+		}
+		else
+		{
+			o.strips.emplace_back();
 
-		glLoadIdentity();
-		gluLookAt(p[Head], (p[LeftHand] + p[RightHand]) / 2., p[Head] - p[Neck]);
+			foreach (i : PosNum::range(v.begin, v.end))
+				o.strips.back().emplace_back(
+					at(v.sequence * i, v.joint, graph),
+					V4f{1, 1, 0, float(std::max(0.0, 0.3 - v.depth(i) * 0.05))});
+		}
 	}
-	else
-		glLoadMatrixd(camera.model_view().data());
-
-	setupLights();
-
-	glEnable(GL_DEPTH);
-	glEnable(GL_DEPTH_TEST);
-
-	grid(style.grid_color, style.grid_size, style.grid_line_width);
-
-	playerDrawer.drawPlayers(position, colors, v.first_person);
 }
 
 #ifndef EMSCRIPTEN
 void renderWindow(
 	std::vector<View> const & views,
-	vector<Viable> const & viables,
-	Graph const & graph,
+	Overlay const & overlay,
 	Position const & position,
 	Camera camera,
 	optional<PlayerJoint> const highlight_joint,
 	PerPlayerJoint<optional<V3>> colors,
 	int const left, int const bottom,
 	int const width, int const height,
-	OrientedPath const & selection,
 	Style const & style,
 	PlayerDrawer const & playerDrawer,
 	function<void()> extraRender)
@@ -386,12 +417,7 @@ void renderWindow(
 
 		if (extraRender) extraRender();
 
-		if (highlight_joint)
-			drawSelection(
-				graph, selection, *highlight_joint,
-				boost::none, &camera, style);
-
-		drawViables(graph, viables, selection, {}, style);
+		drawOverlay(overlay, &camera, style);
 
 		if (highlight_joint)
 		{
@@ -405,9 +431,8 @@ void renderWindow(
 		}
 	}
 }
-#endif
 
-size_t renderWindow(
+void renderWindow(
 	std::vector<View> const & views,
 	vector<Viable> const & viables,
 	Graph const & graph,
@@ -415,45 +440,69 @@ size_t renderWindow(
 	Camera camera,
 	optional<PlayerJoint> const highlight_joint,
 	PerPlayerJoint<optional<V3>> colors,
-	int /*left*/, int /*bottom*/,
+	int const left, int const bottom,
 	int const width, int const height,
 	OrientedPath const & selection,
-	SegmentInSequence const current_segment,
 	Style const & style,
 	PlayerDrawer const & playerDrawer,
-	function<void()> extraRender,
-	vector<BasicVertex> & out)
+	function<void()> extraRender)
 {
-	size_t num = 0;
+	Overlay overlay;
+	if (highlight_joint) addSelection(overlay, graph, selection, *highlight_joint, boost::none);
+	addViables(overlay, graph, viables, selection, boost::none);
 
-	foreach (v : views)
-	{
-		int
-			//x = left + v.x * width,
-			//y = bottom + v.y * height,
-			w = v.w * width,
-			h = v.h * height;
-
-		camera.setViewportSize(v.fov, w, h);
-
-		grid(to_f(style.grid_color), style.grid_size, out);
+	renderWindow(views, overlay, position, camera, highlight_joint, colors,
+		left, bottom, width, height, style, playerDrawer, extraRender);
+}
+#endif
 
-		playerDrawer.drawPlayers(position, colors, v.first_person, out);
+void renderWindow(
+	View const & view,
+	Graph const & graph,
+	Position const & position,
+	Camera const & camera,
+	PlayerJoint const highlight_joint,
+	PerPlayerJoint<optional<V3>> const & colors,
+	optional<Reoriented<Location>> const & location,
+	OrientedPath const & selection,
+	Style const & style,
+	PlayerDrawer const & playerDrawer,
+	ViableCache & viable_cache,
+	WindowVertices & out)
+{
+	out.remade += out.grid.update(std::make_tuple(style.grid_color, style.grid_size),
+		[&](vector<BasicVertex> & v) { grid(to_f(style.grid_color), style.grid_size, v); });
 
-		if (extraRender) extraRender();
+	out.remade += out.players.update(std::make_tuple(position, colors, view.first_person),
+		[&](PlayerInstances & v) { playerDrawer.drawPlayers(position, colors, view.first_person, v); });
 
-		num = out.size();
+	if (!location)
+	{
+		out.remade += out.selection.update(none, [](vector<BasicVertex> &){});
+		out.remade += out.viables.update(none, [](vector<BasicVertex> &){});
+		return;
+	}
 
-		if (highlight_joint)
+	out.remade += out.selection.update(
+		std::make_tuple(graph.revision(), selection, highlight_joint, (*location)->segment),
+		[&](vector<BasicVertex> & v)
+		{
 			drawSelection(
 				playerDrawer.sphereDrawer,
-				graph, selection, *highlight_joint,
-				current_segment, style, out);
+				graph, selection, highlight_joint,
+				(*location)->segment, style, v);
+		});
 
-		drawViables(graph, viables, selection, style, out);
-	}
+	Reoriented<PositionInSequence> const origin = from(segment(*location));
 
-	return num;
+	out.remade += out.viables.update(
+		std::make_tuple(graph.revision(), selection, highlight_joint, origin, quantized(camera)),
+		[&](vector<BasicVertex> & v)
+		{
+			drawViables(graph,
+				viable_cache.viables(graph, origin, highlight_joint, camera),
+				selection, style, v);
+		});
 }
 
 #ifndef EMSCRIPTEN
@@ -473,7 +522,7 @@ void renderScene(
 
 	setupLights();
 
-	grid(style.grid_color, style.grid_size, style.grid_line_width);
+	grid(style);
 
 	{
 		PerPlayerJoint<optional<V3>> colors;
@@ -491,12 +540,18 @@ void renderScene(
 		playerDrawer.drawPlayers(position, colors, {});
 	}
 
-	if (edit_joints.size() == 1)
-		drawSelection(graph, selection, edit_joints.front(), current_segment, nullptr, style);
-	if (browse_joint)
-		drawSelection(graph, selection, *browse_joint, current_segment, nullptr, style);
+	{
+		Overlay overlay;
+
+		if (edit_joints.size() == 1)
+			addSelection(overlay, graph, selection, edit_joints.front(), current_segment);
+		if (browse_joint)
+			addSelection(overlay, graph, selection, *browse_joint, current_segment);
 
-	drawViables(graph, viables, selection, current_segment, style);
+		addViables(overlay, graph, viables, selection, current_segment);
+
+		drawOverlay(overlay, nullptr, style);
+	}
 
 	glDisable(GL_DEPTH_TEST);
 	glPointSize(20);
@@ -4,6 +4,7 @@
 #include "paths.hpp"
 #include "viables.hpp"
 #include "playerdrawer.hpp"
+#include <tuple>
 
 #ifdef USE_FTGL
 #include <FTGL/ftgl.h>
@@ -23,6 +24,16 @@ namespace GrappleMap
 		double fov;
 	};
 
+	class GridLists
+		// Display lists for grids. Only valid in the GL context they were made in.
+	{
+		map<std::tuple<double, double, double, unsigned, unsigned>, unsigned> lists;
+
+	public:
+
+		void draw(V3 color, unsigned size, unsigned line_width);
+	};
+
 	struct Style
 	{
 		V3 grid_color {.5, .5, .5};
@@ -30,6 +41,10 @@ namespace GrappleMap
 		unsigned grid_size = 2;
 		unsigned grid_line_width = 2;
 
+		GridLists * grid_lists = nullptr;
+			// If set, the grid is drawn from (and cached in) these,
+			// so the style must then only be used with their GL context.
+
 		#ifdef USE_FTGL
 			FTGLPixmapFont font{"DejaVuSans.ttf"};
 		#endif
@@ -50,25 +65,105 @@ namespace GrappleMap
 		int left, int bottom, int width, int height,
 		Style const &, PlayerDrawer const &);
 
+	void renderBasic(
+		View const &, Position const &,
+		vector<BasicVertex> const & players, // from PlayerDrawer::drawPlayers for the same position and view
+		Camera,
+		int left, int bottom, int width, int height,
+		Style const &);
+
+	struct Overlay
+		// The selection and viables as the GL renderers draw them, resolved
+		// from the graph, so that they can be drawn without it.
+	{
+		vector<vector<pair<V3, V4f>>> strips;
+			// line strips, drawn over everything else
+		vector<pair<V3, string>> marks;
+			// the selection's positions: numbered if there is a camera
+			// and a font to do it with, otherwise dots
+	};
+
+	void addSelection(Overlay &, Graph const &, OrientedPath const &, PlayerJoint,
+		optional<SegmentInSequence> current_segment);
+
+	void addViables(Overlay &, Graph const &, vector<Viable> const &,
+		OrientedPath const & selection,
+		optional<SegmentInSequence> current_segment);
+
 	void renderWindow(vector<View> const &,
-		vector<Viable> const &, Graph const &, Position const &,
+		Overlay const &, Position const &,
 		Camera, optional<PlayerJoint> highlight_joint,
 		PerPlayerJoint<optional<V3>> colors,
 		int left, int bottom, int width, int height,
-		OrientedPath const &,
 		Style const &, PlayerDrawer const &,
 		function<void()> extraRender = {});
 
-	size_t renderWindow(vector<View> const &,
+	void renderWindow(vector<View> const &,
 		vector<Viable> const &, Graph const &, Position const &,
 		Camera, optional<PlayerJoint> highlight_joint,
 		PerPlayerJoint<optional<V3>> colors,
 		int left, int bottom, int width, int height,
 		OrientedPath const &,
-		SegmentInSequence const current_segment,
 		Style const &, PlayerDrawer const &,
-		function<void()> extraRender,
-		std::vector<BasicVertex> & out);
+		function<void()> extraRender = {});
+
+	template<typename Key, typename T = vector<BasicVertex>>
+	class VertexSegment
+		// Geometry that is only remade when what it is made from changes.
+	{
+		optional<Key> key;
+		T v;
+		unsigned version_ = 0;
+
+	public:
+
+		template<typename F>
+		bool update(Key const & k, F make)
+			// Returns whether the vertices were remade.
+		{
+			if (key && *key == k) return false;
+
+			v.clear();
+			make(v);
+			key = k;
+			++version_;
+			return true;
+		}
+
+		T const & get() const { return v; }
+
+		unsigned version() const { return version_; }
+			// changes whenever the geometry does
+	};
+
+	struct WindowVertices
+		// What the vertex-producing renderWindow makes, split by what each part
+		// depends on. The grid and players are meant to be drawn lit and
+		// depth-tested, the selection and viables on top of them.
+	{
+		VertexSegment<std::tuple<V3, unsigned>> grid;
+
+		VertexSegment<std::tuple<Position, PerPlayerJoint<optional<V3>>, optional<PlayerNum>>, PlayerInstances> players;
+			// to be drawn with instancing (see triangle.vertexshader)
+
+		VertexSegment<optional<std::tuple<size_t, OrientedPath, PlayerJoint, SegmentInSequence>>> selection;
+			// graph revision, selection, highlighted joint, current segment
+
+		VertexSegment<optional<std::tuple<size_t, OrientedPath, PlayerJoint, Reoriented<PositionInSequence>, CameraKey>>> viables;
+			// likewise, plus where viables are looked for from, and the quantized
+			// camera, since determineViables prunes by on-screen distance
+
+		size_t remade = 0;
+			// number of parts remade so far
+	};
+
+	void renderWindow(View const &, Graph const &, Position const &,
+		Camera const &, PlayerJoint highlight_joint,
+		PerPlayerJoint<optional<V3>> const & colors,
+		optional<Reoriented<Location>> const &, OrientedPath const &,
+		Style const &, PlayerDrawer const &,
+		ViableCache &, WindowVertices &);
+		// Without a location, only the grid and the players are drawn.
 
 	void renderScene(Graph const &, Position const &,
 		vector<Viable> const & viables,
@@ -19,6 +19,18 @@ namespace GrappleMap
 		T const & operator*() const { return value; }
 	};
 
+	template<typename T>
+	bool operator==(Reoriented<T> const & a, Reoriented<T> const & b)
+	{
+		return *a == *b && a.reorientation == b.reorientation;
+	}
+
+	template<typename T>
+	bool operator!=(Reoriented<T> const & a, Reoriented<T> const & b)
+	{
+		return !(a == b);
+	}
+
 	template<typename T>
 	inline Reoriented<T> operator*(T x, PositionReorientation r)
 	{
@@ -0,0 +1,138 @@
+#include "resolve.hpp"
+#include <cassert>
+#include <vector>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+namespace GrappleMap
+{
+	namespace
+	{
+		void add_rows(
+			std::uint8_t const * const rows, size_t const n /* bytes per row */,
+			unsigned const count, std::uint16_t * const sums)
+		{
+			size_t i = 0;
+
+			#ifdef __SSE2__
+				__m128i const zero = _mm_setzero_si128();
+
+				for (; i + 16 <= n; i += 16)
+				{
+					__m128i lo = zero, hi = zero;
+
+					for (unsigned r = 0; r != count; ++r)
+					{
+						__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(rows + r*n + i));
+						lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+						hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+					}
+
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(sums + i), lo);
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(sums + i + 8), hi);
+				}
+			#endif
+
+			for (; i != n; ++i)
+			{
+				std::uint16_t t = 0;
+				for (unsigned r = 0; r != count; ++r) t += rows[r*n + i];
+				sums[i] = t;
+			}
+		}
+	}
+
+	void resolve(
+		std::uint8_t const * const in,
+		unsigned const width, unsigned const height, unsigned const factor,
+		bool const swap_rb, bool const flip,
+		std::uint8_t * const out)
+	{
+		assert(factor != 0 && factor <= 16); // so that column sums fit in 16 bits
+
+		size_t const in_row = size_t(width) * factor * 3;
+		unsigned const
+			area = factor * factor,
+			r = swap_rb ? 2 : 0,
+			b = 2 - r;
+
+		std::vector<std::uint16_t> sums(in_row);
+
+		for (unsigned y = 0; y != height; ++y)
+		{
+			add_rows(in + y * factor * in_row, in_row, factor, sums.data());
+
+			std::uint16_t const * s = sums.data();
+			std::uint8_t * o = out + size_t(flip ? height - 1 - y : y) * width * 3;
+
+			if (factor == 2)
+				for (unsigned x = 0; x != width; ++x, s += 6, o += 3)
+				{
+					o[r] = (s[0] + s[3]) >> 2;
+					o[1] = (s[1] + s[4]) >> 2;
+					o[b] = (s[2] + s[5]) >> 2;
+				}
+			else
+				for (unsigned x = 0; x != width; ++x, o += 3)
+				{
+					unsigned c0 = 0, c1 = 0, c2 = 0;
+
+					for (unsigned i = 0; i != factor; ++i, s += 3)
+					{
+						c0 += s[0];
+						c1 += s[1];
+						c2 += s[2];
+					}
+
+					o[r] = c0 / area;
+					o[1] = c1 / area;
+					o[b] = c2 / area;
+				}
+		}
+	}
+
+	void accumulate(
+		std::uint8_t const * const in, std::size_t const n,
+		std::uint16_t const weight, std::uint32_t * const sums)
+	{
+		assert(weight <= 257); // so that weighted bytes fit in 16 bits
+
+		std::size_t i = 0;
+
+		#ifdef __SSE2__
+			__m128i const zero = _mm_setzero_si128(), w = _mm_set1_epi16(weight);
+
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+
+				__m128i const
+					lo = _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), w),
+					hi = _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), w);
+
+				__m128i * const s = reinterpret_cast<__m128i *>(sums + i);
+
+				_mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(lo, zero)));
+				_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(lo, zero)));
+				_mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(hi, zero)));
+				_mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(hi, zero)));
+			}
+		#endif
+
+		for (; i != n; ++i) sums[i] += in[i] * weight;
+	}
+
+	void average(
+		std::uint32_t const * const sums, std::size_t const n,
+		std::uint32_t const total_weight, std::uint8_t * const out)
+	{
+		assert(total_weight != 0);
+
+		std::uint32_t const half = total_weight / 2;
+
+		for (std::size_t i = 0; i != n; ++i)
+			out[i] = (sums[i] + half) / total_weight;
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef GRAPPLEMAP_RESOLVE_HPP
+#define GRAPPLEMAP_RESOLVE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace GrappleMap
+{
+	void resolve(
+		std::uint8_t const * in, // (width*factor) by (height*factor) 3-byte pixels
+		unsigned width, unsigned height, unsigned factor /* at most 16 */,
+		bool swap_rb, bool flip,
+		std::uint8_t * out); // width by height 3-byte pixels
+		// Averages factor*factor blocks, optionally swapping the first and
+		// third channel and reversing the row order (for GL framebuffers,
+		// which are bottom row first).
+
+	void accumulate(
+		std::uint8_t const * in, std::size_t n,
+		std::uint16_t weight /* at most 257 */,
+		std::uint32_t * sums);
+		// sums[i] += in[i] * weight, for i in [0, n)
+
+	void average(
+		std::uint32_t const * sums, std::size_t n,
+		std::uint32_t total_weight,
+		std::uint8_t * out);
+		// out[i] = sums[i] / total_weight, rounded
+}
+
+#endif
@@ -50,9 +50,11 @@ class Rewindable
 {
 	C c;
 	std::vector<std::vector<std::function<void()>>> ff;
+	size_t revision_ = 0;
 
 	void add(std::function<void()> f)
 	{
+		++revision_;
 		if (ff.empty()) ff.emplace_back();
 		ff.back().push_back(std::move(f));
 	}
@@ -63,6 +65,9 @@ public:
 
 	C const * operator->() const { return &c; }
 
+	size_t revision() const { return revision_; }
+		// increases with every write, including by rewind()
+
 	// write:
 
 	template<typename... Path>
@@ -136,6 +141,24 @@ public:
 			x.insert(x.begin() + i, std::move(v));
 		}
 
+		// for sets:
+
+		template<typename T>
+		void insert_key(T v)
+		{
+			auto self = *this;
+			if (resolve().insert(v).second)
+				re.add([self, v]{ self.resolve().erase(v); });
+		}
+
+		template<typename T>
+		void erase_key(T v)
+		{
+			auto self = *this;
+			if (resolve().erase(v) != 0)
+				re.add([self, v]{ self.resolve().insert(v); });
+		}
+
 		template<typename T>
 		bool operator==(T const & x) const { return resolve() == x; }
 
@@ -154,6 +177,8 @@ public:
 	{
 		if (ff.empty()) return;
 
+		++revision_;
+
 		for (auto i = ff.back().rbegin(); i != ff.back().rend(); ++i)
 			(*i)();
 
@@ -270,83 +270,21 @@ var force;
 var paged_positions;
 var paged_transitions;
 
-function node_has_tag(node, tag)
-{
-	return node.tags.indexOf(tag) != -1;
-}
-
-function trans_has_tag(trans, tag)
-{
-	return trans.tags.indexOf(tag) != -1;
-}
-
-function trans_kinda_has_tag(trans, tag)
-{
-	return (trans_has_tag(trans, tag) ||
-		(node_has_tag(db.nodes[trans.from], tag)
-		&& node_has_tag(db.nodes[trans.to], tag)));
-}
+var query_result = { nodes: [], transitions: [], refinements: [] };
+	// from cursor_canvas_query (see query_engine.hpp)
+var node_selected = []; // by node id
+var trans_selected = []; // by transition id
 
 function node_is_selected(node)
 {
-	for (var i = 0; i != selected_tags.length; ++i)
-		if (node_has_tag(node, selected_tags[i][0]) != selected_tags[i][1])
-			return false;
-
-	for (var i = 0; i != substrs.length; ++i)
-		if (!any_has_substr(node.description, substrs[i]) &&
-			!any_has_substr(node.tags, substrs[i]))
-			return false;
-
-	return true;
+	return node_selected[node.id] === true;
 }
 
 // todo: encode substrs in query string
 
-function any_has_substr(a, s)
-{
-	for (var i = 0; i != a.length; ++i)
-		if (a[i].toLowerCase().indexOf(s) != -1)
-			return true;
-	return false;
-}
-
 function trans_is_selected(trans)
 {
-	for (var i = 0; i != selected_tags.length; ++i)
-		if (trans_kinda_has_tag(trans, selected_tags[i][0]) != selected_tags[i][1])
-			return false;
-
-	for (var i = 0; i != substrs.length; ++i)
-		if (!any_has_substr(trans.description, substrs[i]) &&
-			!any_has_substr(trans.tags, substrs[i]))
-			return false;
-
-	// todo: also implied tags?
-
-	return true;
-}
-
-function tag_refines(tag)
-{
-	var r = {
-		nodes_in: 0,
-		nodes_out: 0,
-		trans_in: 0,
-		trans_out: 0 };
-
-	selected_nodes.forEach(function(n){
-		if (node_has_tag(db.nodes[n], tag)) ++r.nodes_in; else ++r.nodes_out;
-	});
-
-	selected_edges.forEach(function(trans){
-		if (trans_kinda_has_tag(db.transitions[trans], tag))
-			++r.trans_in;
-		else
-			++r.trans_out;
-	});
-
-	return r;
+	return trans_selected[trans.id] === true;
 }
 
 var results_dirty = false;
@@ -371,19 +309,19 @@ function recompute_results()
 	{
 		results_dirty = false;
 
-		selected_nodes = [];
-		for (var n = 0; n != db.nodes.length; ++n)
-			if (node_is_selected(db.nodes[n]))
-				selected_nodes.push(n);
+		query_result = Module.cursor_canvas_query(selected_tags, substrs);
+
+		selected_nodes = query_result.nodes;
+		selected_edges = query_result.transitions;
+
+		node_selected = [];
+		selected_nodes.forEach(function(n) { node_selected[n] = true; });
+		trans_selected = [];
+		selected_edges.forEach(function(t) { trans_selected[t] = true; });
 
 		if (selected_nodes.length != 0)
 			Module.cursor_canvas_goto(selected_nodes[0]);
 
-		selected_edges = [];
-		for (var n = 0; n != db.transitions.length; ++n)
-			if (trans_is_selected(db.transitions[n]))
-				selected_edges.push(n);
-
 		update_tag_list();
 		update_position_pics();
 		update_transition_pics();
@@ -503,14 +441,12 @@ function refinements(b)
 
 	var sst = sorted_selected_tags();
 
-	db.tags.forEach(function(t)
+	query_result.refinements.forEach(function(r)
 	{
-		var r = tag_refines(t);
-		if (sst[b ? 1 : 0].indexOf(t) == -1
-			&& ((r.nodes_in != 0 && r.nodes_out != 0) || (r.trans_in != 0 && r.trans_out != 0)))
-			options.add(simple_option(t
+		if (sst[b ? 1 : 0].indexOf(r.tag) == -1)
+			options.add(simple_option(r.tag
 				+ " (" + (b ? r.nodes_in : r.nodes_out)
-				+ "p, " + (b ? r.trans_in : r.trans_out) + "t)", t));
+				+ "p, " + (b ? r.trans_in : r.trans_out) + "t)", r.tag));
 	});
 
 	if (options.length == 1) return null;
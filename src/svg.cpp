@@ -0,0 +1,293 @@
+#include "svg.hpp"
+#include "camera.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace GrappleMap {
+
+namespace
+{
+	struct Disc { V2 center; double radius; };
+
+	struct Shape
+	{
+		double depth;
+		V3 color;
+		string element; // without fill and closing
+	};
+
+	class Projector
+		// Camera-to-SVG coordinates, which have y pointing down.
+	{
+		Camera camera;
+		double x0, y0, height, radius_scale;
+
+	public:
+
+		Projector(Camera const & c, View const & v, unsigned const width, unsigned const h)
+			: camera(c), x0(v.x * width), y0(v.y * h), height(h)
+		{
+			if (v.first_person) error("svg images do not support first-person views");
+
+			camera.setViewportSize(v.fov, v.w * width, v.h * h);
+			radius_scale = camera.projection()[5] * v.h * h / 2;
+		}
+
+		double depth(V3 const p) const { return (camera.full() * V4(p, 1)).w; }
+
+		V2 operator()(V3 const p) const
+		{
+			V2 const s = world2screen(camera, p);
+			return {x0 + s.x, height - y0 - s.y};
+		}
+
+		Disc disc(V3 const p, double const radius) const
+		{
+			return {(*this)(p), radius * radius_scale / depth(p)};
+		}
+	};
+
+	double const near = 0.01;
+
+	string num(double const d)
+	{
+		char buf[32];
+		std::snprintf(buf, sizeof buf, "%.1f", d);
+		string s = buf;
+		if (s.size() > 2 && s.compare(s.size() - 2, 2, ".0") == 0) s.resize(s.size() - 2);
+		return s == "-0" ? "0" : s;
+	}
+
+	string hex(V3 const c)
+	{
+		auto byte = [](double const d){ return int(std::max(0., std::min(1., d)) * 255 + .5); };
+		char buf[8];
+		std::snprintf(buf, sizeof buf, "#%02x%02x%02x", byte(c.x), byte(c.y), byte(c.z));
+		return buf;
+	}
+
+	void polygon(vector<V2> pts, string & d)
+		// Appends a closed subpath. All subpaths are wound the same way,
+		// so that overlapping ones do not cancel out under the nonzero rule.
+	{
+		if (pts.empty()) return;
+
+		double area = 0;
+		for (size_t i = 0; i != pts.size(); ++i)
+		{
+			V2 const a = pts[i], b = pts[(i + 1) % pts.size()];
+			area += a.x * b.y - b.x * a.y;
+		}
+		if (area < 0) std::reverse(pts.begin(), pts.end());
+
+		char c = 'M';
+		foreach (p : pts)
+		{
+			d += c; d += num(p.x); d += ' '; d += num(p.y);
+			c = 'L';
+		}
+		d += 'Z';
+	}
+
+	vector<V2> hull(Disc const & a, Disc const & b)
+		// Quad between the outer tangents of two discs.
+	{
+		V2 const ab = b.center - a.center;
+		double const l = norm2(ab);
+
+		if (l <= std::abs(a.radius - b.radius)) return {}; // one contains the other
+
+		V2 const u = ab / l, n{-u.y, u.x};
+		double const s = (a.radius - b.radius) / l, c = std::sqrt(1 - s*s);
+		V2 const m = u * s + n * c, k = u * s - n * c;
+
+		return
+			{ a.center + m * a.radius, b.center + m * b.radius
+			, b.center + k * b.radius, a.center + k * a.radius };
+	}
+
+	void add_path(vector<Shape> & shapes, double const depth, V3 const color, string const & d)
+	{
+		if (!d.empty()) shapes.push_back({depth, color, "<path d='" + d + "'"});
+	}
+
+	vector<Shape> shapes(Position const & pos, Projector const & proj)
+		// Mirrors PlayerDrawer::drawPlayers, minus anything too close to the eye.
+	{
+		vector<Shape> r;
+
+		foreach (pj : playerJoints)
+		{
+			V3 const p = pos[pj];
+			double const depth = proj.depth(p);
+			if (depth < near) continue;
+
+			Disc const d = proj.disc(p, jointDefs[pj.joint].radius);
+
+			r.push_back({depth, playerDefs[pj.player].color,
+				"<circle cx='" + num(d.center.x) + "' cy='" + num(d.center.y)
+				+ "' r='" + num(d.radius) + "'"});
+		}
+
+		foreach (pn : playerNums())
+		{
+			V3 const color = playerDefs[pn].color;
+			Player const & player = pos[pn];
+
+			auto visible = [&](V3 const p){ return proj.depth(p) >= near; };
+
+			foreach (l : limbs())
+			{
+				if (!l.visible) continue;
+
+				auto const a = l.ends[0], b = l.ends[1];
+				double const ar = jointDefs[a].radius, br = jointDefs[b].radius;
+
+				if (!visible(player[a]) || !visible(player[b])) continue;
+
+				Disc const da = proj.disc(player[a], ar), db = proj.disc(player[b], br);
+
+				string d;
+
+				if (l.midpointRadius)
+				{
+					// both halves in one path, so that they do not show a seam
+
+					auto const mid = between(player[a], player[b]);
+					Disc const dm = proj.disc(mid, *l.midpointRadius);
+					polygon(hull(da, dm), d);
+					polygon(hull(dm, db), d);
+				}
+				else polygon(hull(da, db), d);
+
+				add_path(r, proj.depth(between(player[a], player[b])), color, d);
+			}
+
+			auto tri = [&](Joint const x, Joint const y, Joint const z)
+				{
+					if (!visible(player[x]) || !visible(player[y]) || !visible(player[z])) return;
+
+					Disc const
+						a = proj.disc(player[x], jointDefs[x].radius),
+						b = proj.disc(player[y], jointDefs[y].radius),
+						e = proj.disc(player[z], jointDefs[z].radius);
+
+					string d;
+					polygon({a.center, b.center, e.center}, d);
+					polygon(hull(a, b), d);
+					polygon(hull(b, e), d);
+					polygon(hull(e, a), d);
+					add_path(r, proj.depth((player[x] + player[y] + player[z]) / 3.), color, d);
+				};
+
+			tri(LeftHip, Core, RightHip);
+			tri(LeftShoulder, Neck, RightShoulder);
+			tri(LeftShoulder, Core, RightShoulder);
+			tri(LeftAnkle, LeftHeel, LeftToe);
+			tri(RightAnkle, RightHeel, RightToe);
+		}
+
+		return r;
+	}
+
+	void grid(Projector const & proj, SvgStyle const & style, string & out)
+	{
+		string d;
+
+		auto line = [&](V3 a, V3 b)
+			{
+				double const da = proj.depth(a), db = proj.depth(b);
+
+				if (da < near && db < near) return;
+				if (da < near) a = a + (b - a) * ((near - da) / (db - da));
+				if (db < near) b = b + (a - b) * ((near - db) / (da - db));
+
+				V2 const p = proj(a), q = proj(b);
+				d += 'M' + num(p.x) + ' ' + num(p.y) + 'L' + num(q.x) + ' ' + num(q.y);
+			};
+
+		double const size = style.grid_size;
+
+		for (double i = size * -2; i <= size * 2; ++i)
+		{
+			line(V3{i/2, 0, -size}, V3{i/2, 0, size});
+			line(V3{-size, 0, i/2}, V3{size, 0, i/2});
+		}
+
+		if (!d.empty())
+			out += "<path fill='none' stroke='" + hex(style.grid_color)
+				+ "' stroke-width='" + num(style.grid_line_width) + "' d='" + d + "'/>";
+	}
+
+	string frame(
+		Position const & pos, Camera const & camera, View const & view,
+		unsigned const width, unsigned const height, SvgStyle const & style)
+	{
+		Projector const proj(camera, view, width, height);
+
+		string out;
+		grid(proj, style, out);
+
+		vector<Shape> v = shapes(pos, proj);
+		if (v.empty()) return out;
+
+		std::sort(v.begin(), v.end(),
+			[](Shape const & a, Shape const & b){ return a.depth > b.depth; });
+
+		// Farther shapes are slightly darker, so that limbs in front
+		// of the same player's body stay distinguishable.
+
+		double const
+			nearest = v.back().depth,
+			range = std::max(v.front().depth - nearest, 1e-6);
+
+		foreach (s : v)
+			out += s.element + " fill='"
+				+ hex(s.color * (1 - .35 * (s.depth - nearest) / range)) + "'/>";
+
+		return out;
+	}
+
+	string header(unsigned const width, unsigned const height, SvgStyle const & style)
+	{
+		string const w = to_string(width), h = to_string(height);
+
+		return "<svg xmlns='http://www.w3.org/2000/svg' width='" + w + "' height='" + h
+			+ "' viewBox='0 0 " + w + ' ' + h + "'>"
+			+ "<rect width='" + w + "' height='" + h + "' fill='" + hex(style.background_color) + "'/>";
+	}
+}
+
+string svg(
+	Position const & pos, Camera const & camera, View const & view,
+	unsigned const width, unsigned const height, SvgStyle const & style)
+{
+	return header(width, height, style)
+		+ frame(pos, camera, view, width, height, style)
+		+ "</svg>\n";
+}
+
+string svg(
+	vector<pair<Position, Camera>> const & frames, double const fps,
+	View const & view, unsigned const width, unsigned const height, SvgStyle const & style)
+{
+	if (frames.empty()) error("svg animation without frames");
+
+	// Each frame is a group that is only visible during its own slice
+	// of the cycle, offset by its animation-delay.
+
+	double const duration = frames.size() / fps;
+
+	string out = header(width, height, style)
+		+ "<style>g{visibility:hidden;animation:f " + to_string(long(duration * 1000 + .5)) + "ms step-end infinite}"
+		+ "@keyframes f{0%{visibility:visible}" + to_string(100. / frames.size()) + "%{visibility:hidden}}</style>";
+
+	for (size_t i = 0; i != frames.size(); ++i)
+		out += "<g style='animation-delay:" + to_string(long(i * 1000 / fps)) + "ms'>"
+			+ frame(frames[i].first, frames[i].second, view, width, height, style)
+			+ "</g>";
+
+	return out + "</svg>\n";
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef GRAPPLEMAP_SVG_HPP
+#define GRAPPLEMAP_SVG_HPP
+
+#include "positions.hpp"
+#include "rendering.hpp"
+
+namespace GrappleMap
+{
+	class Camera;
+
+	struct SvgStyle
+	{
+		V3 background_color {1, 1, 1};
+		V3 grid_color {.8, .8, .8};
+		unsigned grid_size = 2;
+		double grid_line_width = 1;
+	};
+
+	string svg(
+		Position const &, Camera const &, View const &,
+		unsigned width, unsigned height, SvgStyle const &);
+		// Players as depth-sorted discs (joints) and tapered quads (limbs),
+		// projected with world2screen. No first-person views.
+
+	string svg(
+		vector<pair<Position, Camera>> const & frames, double frames_per_second,
+		View const &, unsigned width, unsigned height, SvgStyle const &);
+		// Loops through the frames with a CSS animation.
+}
+
+#endif
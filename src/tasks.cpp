@@ -0,0 +1,219 @@
+#include "tasks.hpp"
+#include <cassert>
+
+namespace GrappleMap
+{
+	struct Executor::Node
+	{
+		function<void()> work;
+		std::atomic<size_t> unmet{1}; // unfinished dependencies, plus one while spawn() registers them
+		std::atomic<bool> skip{false};
+
+		std::mutex m;
+		bool done = false, failed = false;
+		vector<Task> dependents;
+	};
+
+	namespace
+	{
+		thread_local Executor const * current_executor = nullptr;
+		thread_local size_t current_worker = 0;
+	}
+
+	size_t Executor::default_threads()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	optional<size_t> Executor::worker_index()
+	{
+		if (!current_executor) return none;
+		return current_worker;
+	}
+
+	Executor::Executor(size_t const n, size_t const mp)
+		: max_pending(std::max<size_t>(mp, 1))
+	{
+		for (size_t i = 0; i != std::max<size_t>(n, 1); ++i)
+			queues.emplace_back(new Worker);
+
+		for (size_t i = 0; i != queues.size(); ++i)
+			threads.emplace_back([this, i]{ work(i); });
+	}
+
+	Executor::~Executor()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m);
+			pending_changed.wait(lock, [&]{ return pending == 0; });
+			stopping = true;
+		}
+
+		work_available.notify_all();
+
+		foreach (t : threads) t.join();
+	}
+
+	void Executor::schedule(Task t)
+	{
+		size_t q;
+
+		if (current_executor == this) q = current_worker;
+		else
+		{
+			std::lock_guard<std::mutex> lock(m);
+			q = next_queue++ % queues.size();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(queues[q]->m);
+			queues[q]->tasks.push_back(move(t));
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			++queued;
+		}
+
+		work_available.notify_one();
+	}
+
+	Executor::Task Executor::take(size_t const w)
+	{
+		{
+			Worker & own = *queues[w];
+			std::lock_guard<std::mutex> lock(own.m);
+			if (!own.tasks.empty())
+			{
+				Task t = move(own.tasks.back());
+				own.tasks.pop_back();
+				return t;
+			}
+		}
+
+		for (size_t i = 1; i != queues.size(); ++i)
+		{
+			Worker & victim = *queues[(w + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.m);
+			if (!victim.tasks.empty())
+			{
+				Task t = move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return t;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void Executor::run(Task const & t)
+	{
+		bool failed = t->skip;
+
+		if (!failed)
+			try { t->work(); }
+			catch (...)
+			{
+				failed = true;
+				std::lock_guard<std::mutex> lock(m);
+				if (!first_error) first_error = std::current_exception();
+			}
+
+		t->work = nullptr; // release captured state early
+
+		vector<Task> dependents;
+		{
+			std::lock_guard<std::mutex> lock(t->m);
+			t->done = true;
+			t->failed = failed;
+			dependents.swap(t->dependents);
+		}
+
+		foreach (d : dependents)
+		{
+			if (failed) d->skip = true;
+			if (--d->unmet == 0) schedule(d);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m);
+			--pending;
+		}
+
+		pending_changed.notify_all();
+	}
+
+	void Executor::work(size_t const w)
+	{
+		current_executor = this;
+		current_worker = w;
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m);
+				work_available.wait(lock, [&]{ return queued != 0 || stopping; });
+				if (queued == 0) return;
+				--queued;
+			}
+
+			// Every decrement of 'queued' is matched by a task in some deque,
+			// though another worker may hold it briefly while we look.
+			Task t;
+			while (!(t = take(w))) std::this_thread::yield();
+
+			run(t);
+		}
+	}
+
+	Executor::Task Executor::spawn(function<void()> f, vector<Task> const & deps)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m);
+
+			if (current_executor != this)
+				pending_changed.wait(lock, [&]{ return pending < max_pending; });
+
+			++pending;
+		}
+
+		auto t = std::make_shared<Node>();
+		t->work = move(f);
+
+		foreach (d : deps)
+		{
+			if (!d) continue;
+
+			std::lock_guard<std::mutex> lock(d->m);
+
+			if (d->done)
+			{
+				if (d->failed) t->skip = true;
+			}
+			else
+			{
+				++t->unmet;
+				d->dependents.push_back(t);
+			}
+		}
+
+		if (--t->unmet == 0) schedule(t);
+
+		return t;
+	}
+
+	void Executor::wait()
+	{
+		assert(current_executor != this);
+
+		std::unique_lock<std::mutex> lock(m);
+		pending_changed.wait(lock, [&]{ return pending == 0; });
+
+		if (first_error)
+		{
+			auto e = first_error;
+			first_error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+}
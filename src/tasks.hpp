@@ -0,0 +1,161 @@
+#ifndef GRAPPLEMAP_TASKS_HPP
+#define GRAPPLEMAP_TASKS_HPP
+
+#include "util.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace GrappleMap
+{
+	class Executor
+		// Runs a DAG of tasks on a fixed set of worker threads.
+		//
+		// Every worker owns a deque. Tasks that become ready on a worker
+		// (because that worker spawned them or finished their last dependency)
+		// go to the back of its own deque and are popped LIFO, so a render task
+		// is typically followed directly by its encode task while the frames
+		// are still hot. Idle workers steal from the front of other deques.
+		//
+		// spawn() called from outside the pool blocks while too many tasks are
+		// pending, which is what keeps the memory held by queued work bounded.
+	{
+		struct Node;
+		struct Worker { std::deque<std::shared_ptr<Node>> tasks; std::mutex m; };
+
+		std::vector<std::unique_ptr<Worker>> queues;
+		std::vector<std::thread> threads;
+
+		std::mutex m;
+		std::condition_variable work_available, pending_changed;
+		size_t queued = 0, pending = 0, next_queue = 0;
+		size_t const max_pending;
+		bool stopping = false;
+		std::exception_ptr first_error;
+
+		void schedule(std::shared_ptr<Node>);
+		std::shared_ptr<Node> take(size_t worker);
+		void run(std::shared_ptr<Node> const &);
+		void work(size_t worker);
+
+	public:
+
+		using Task = std::shared_ptr<Node>;
+
+		explicit Executor(size_t threads = default_threads(), size_t max_pending = 256);
+		~Executor();
+
+		Executor(Executor const &) = delete;
+		Executor & operator=(Executor const &) = delete;
+
+		Task spawn(function<void()>, vector<Task> const & dependencies = {});
+			// A task whose dependency threw is skipped.
+
+		void wait();
+			// Blocks until no tasks are pending, then rethrows the first
+			// exception thrown by a task, if any. Must not be called from a task.
+
+		size_t size() const { return threads.size(); }
+
+		static size_t default_threads();
+
+		static optional<size_t> worker_index();
+			// Index of the calling worker thread in its pool, if any.
+	};
+
+	template<typename K, typename V>
+	class Memo
+		// Thread-safe memoization with a bounded total weight (by default,
+		// the number of entries). Concurrent requests for the same key
+		// compute the value once; the least recently used completed entries
+		// are evicted first.
+	{
+		struct Entry
+		{
+			K key;
+			std::shared_future<V> value;
+			size_t weight; // 0 while being computed
+		};
+
+		std::mutex m;
+		std::list<Entry> lru; // most recently used first
+		map<K, typename std::list<Entry>::iterator> index;
+		size_t const capacity;
+		function<size_t(V const &)> const weigh;
+		size_t total = 0; // of completed entries
+
+		void evict()
+		{
+			for (auto i = lru.end(); total > capacity && i != lru.begin(); )
+			{
+				--i;
+				if (i->weight == 0) continue;
+				total -= i->weight;
+				index.erase(i->key);
+				i = lru.erase(i);
+			}
+		}
+
+	public:
+
+		explicit Memo(size_t const c, function<size_t(V const &)> w = nullptr)
+			: capacity(c), weigh(w)
+		{}
+
+		template<typename F>
+		V operator()(K const & k, F make)
+		{
+			std::unique_lock<std::mutex> lock(m);
+
+			auto i = index.find(k);
+
+			if (i != index.end())
+			{
+				lru.splice(lru.begin(), lru, i->second);
+				auto f = i->second->value;
+				lock.unlock();
+				return f.get();
+			}
+
+			std::promise<V> p;
+			lru.push_front(Entry{k, p.get_future().share(), 0});
+			index[k] = lru.begin();
+			auto f = lru.front().value;
+			lock.unlock();
+
+			try
+			{
+				V v = make();
+				size_t const w = std::max<size_t>(1, weigh ? weigh(v) : 1);
+				p.set_value(move(v));
+
+				lock.lock();
+				index[k]->weight = w; // pending entries are never evicted, so it is still there
+				total += w;
+				evict();
+			}
+			catch (...)
+			{
+				p.set_exception(std::current_exception());
+
+				lock.lock();
+				auto j = index.find(k);
+				if (j != index.end())
+				{
+					lru.erase(j->second);
+					index.erase(j);
+				}
+			}
+
+			return f.get();
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "thumbnails.hpp"
+#include "metadata.hpp"
+
+namespace GrappleMap
+{
+	vector<Position> frames_for_sequence(Graph const & graph, SeqNum const seqNum)
+	{
+		unsigned const frames_per_pos = graph[seqNum].detailed ? 3 : 5;
+
+		PositionInSequence location{seqNum, 0};
+
+		vector<Position> r(10, at(location, graph));
+
+		for (; next(location, graph); location = *next(location, graph))
+			for (unsigned howfar = 0; howfar != frames_per_pos; ++howfar)
+				r.push_back(between(
+					at(location, graph),
+					at(*next(location, graph), graph),
+					howfar / double(frames_per_pos)));
+
+		r.resize(r.size() + 10, graph[seqNum].positions.back());
+
+		return r;
+	}
+
+	void orient_transition_frames(Graph const & graph, SeqNum const sn, vector<Position> & frames)
+	{
+		if (graph[sn].from.reorientation.swap_players)
+			foreach (p : frames) swap_players(p);
+
+		auto const reo = canonical_reorientation_with_mirror(frames.front());
+
+		foreach (p : frames) p = reo(p);
+	}
+
+	vector<Position> transition_frames(Graph const & graph, SeqNum const sn)
+	{
+		vector<Position> v = frames_for_sequence(graph, sn);
+		orient_transition_frames(graph, sn, v);
+		return v;
+	}
+
+	vector<Position> smoothen(vector<Position> v)
+	{
+		Position last_pos = v[0];
+
+		foreach (p : v)
+		foreach (j : playerJoints)
+		{
+			double const lag = std::min(0.55, 0.3 + p[j].y);
+			p[j] = last_pos[j] = last_pos[j] * lag + p[j] * (1 - lag);
+		}
+
+		return v;
+	}
+
+	ImageMaker::BgColor bg_color(bool const top, bool const bottom)
+	{
+		if (top) return ImageMaker::RedBg;
+		if (bottom) return ImageMaker::BlueBg;
+		return ImageMaker::WhiteBg;
+	}
+
+	ImageMaker::BgColor bg_color(Graph const & graph, SeqNum const sn)
+	{
+		auto const props = properties(graph[sn]);
+		return bg_color(elem("top", props), elem("bottom", props));
+	}
+
+	string position_image(
+		ImageMaker & mkimg, Graph const & graph, NodeNum const n, ImageView const view,
+		unsigned const width, unsigned const height)
+	{
+		auto const pos_to_show = orient_canonically_with_mirror(graph[n].position);
+
+		return mkimg.png(pos_to_show, ymax(pos_to_show), view,
+			width, height, ImageMaker::WhiteBg, 'p' + to_string(n.index));
+	}
+
+	string transition_gif(
+		ImageMaker & mkimg,
+		vector<Position> frames,
+		ImageView const v,
+		ImageMaker::BgColor const bg_color,
+		string const base_linkname)
+	{
+		return mkimg.gif(smoothen(frames), v, 200, 150, bg_color, base_linkname);
+	}
+
+	string transition_gifs(
+		ImageMaker & mkimg,
+		vector<Position> frames,
+		ImageMaker::BgColor const bg_color,
+		string const base_linkname)
+	{
+		return mkimg.gifs(smoothen(frames), 200, 150, bg_color, base_linkname);
+	}
+}
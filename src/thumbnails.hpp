@@ -0,0 +1,40 @@
+#ifndef GRAPPLEMAP_THUMBNAILS_HPP
+#define GRAPPLEMAP_THUMBNAILS_HPP
+
+#include "images.hpp"
+
+namespace GrappleMap
+{
+	// How the site's position images and transition animations are made,
+	// shared by mkpospages and the render server so that both produce
+	// the same files under the same names.
+
+	vector<Position> frames_for_sequence(Graph const &, SeqNum);
+
+	vector<Position> transition_frames(Graph const &, SeqNum);
+		// frames_for_sequence, oriented the way the standalone animation shows them
+
+	void orient_transition_frames(Graph const &, SeqNum, vector<Position> &);
+
+	vector<Position> smoothen(vector<Position>);
+
+	ImageMaker::BgColor bg_color(bool top, bool bottom);
+	ImageMaker::BgColor bg_color(Graph const &, SeqNum);
+
+	string position_image(
+		ImageMaker &, Graph const &, NodeNum, ImageView,
+		unsigned width, unsigned height);
+		// Returns the link name, e.g. p123n480x360.png.
+
+	string transition_gif(
+		ImageMaker &, vector<Position> frames, ImageView,
+		ImageMaker::BgColor, string base_linkname);
+		// Returns the link name, e.g. t55200x150n.mp4.
+
+	string transition_gifs(
+		ImageMaker &, vector<Position> frames,
+		ImageMaker::BgColor, string base_linkname);
+		// All views at once. Returns the link name without view code and extension.
+}
+
+#endif
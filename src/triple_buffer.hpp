@@ -0,0 +1,44 @@
+#ifndef GRAPPLEMAP_TRIPLE_BUFFER_HPP
+#define GRAPPLEMAP_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+namespace GrappleMap
+{
+	template<typename T>
+	class TripleBuffer
+		// Hands values from one writer thread to one reader thread without
+		// either ever waiting for the other. The reader always gets the most
+		// recently posted value; values it had no time for are skipped.
+		// Same interface as Vrui's Threads::TripleBuffer.
+	{
+		static constexpr unsigned fresh = 4;
+
+		T slots[3];
+		unsigned back = 0, front = 1; // owned by the writer and the reader, respectively
+		std::atomic<unsigned> middle{2}; // slot index, plus 'fresh' if the reader has not yet seen it
+
+	public:
+
+		// writer
+
+		T & startNewValue() { return slots[back]; }
+			// May still hold an older value, which must be overwritten.
+
+		void postNewValue() { back = middle.exchange(back | fresh) & 3; }
+
+		// reader
+
+		bool lockNewValue()
+			// Returns whether there was a new value.
+		{
+			if (!(middle.load() & fresh)) return false;
+			front = middle.exchange(front) & 3;
+			return true;
+		}
+
+		T const & getLockedValue() const { return slots[front]; }
+	};
+}
+
+#endif
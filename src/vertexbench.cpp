@@ -0,0 +1,156 @@
+#include "camera.hpp"
+#include "persistence.hpp"
+#include "rendering.hpp"
+#include "graph_util.hpp"
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <iomanip>
+
+using namespace GrappleMap;
+
+namespace
+{
+	struct Config
+	{
+		string db;
+		unsigned frames;
+		uint32_t transition;
+	};
+
+	optional<Config> config_from_args(int const argc, char const * const * const argv)
+	{
+		namespace po = boost::program_options;
+
+		po::options_description desc("options");
+		desc.add_options()
+			("help,h",
+				"show this help")
+			("db",
+				po::value<string>()->default_value("GrappleMap.txt"),
+				"database file")
+			("frames",
+				po::value<unsigned>()->default_value(600),
+				"number of frames per scenario")
+			("transition",
+				po::value<uint32_t>()->default_value(1383),
+				"selected transition (the web editor starts at 1383)");
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help"))
+		{
+			cout << desc <<
+				"\nTimes the web editor's vertex generation on the CPU, without a GL context, "
+				"with and without keeping WindowVertices and ViableCache across frames.\n";
+
+			return none;
+		}
+
+		return Config
+			{ vm["db"].as<string>()
+			, vm["frames"].as<unsigned>()
+			, vm["transition"].as<uint32_t>() };
+	}
+
+	struct Frame
+	{
+		Reoriented<Location> location;
+		Camera camera;
+	};
+
+	using Scenario = function<void(unsigned i, Frame &)>;
+
+	void run(string const & name, Graph const & graph, OrientedPath const & selection,
+		Frame start, Scenario const & scenario, unsigned const frames)
+	{
+		Style style;
+		style.grid_size = 4;
+		PlayerDrawer const playerDrawer;
+		View const view{0, 0, 1, 1, none, 60};
+		PlayerJoint const joint{player0, LeftWrist};
+
+		PerPlayerJoint<optional<V3>> colors;
+		foreach (j : playerJoints) colors[j] = white;
+		colors[joint] = yellow;
+
+		auto measure = [&](bool const keep)
+			{
+				Frame f = start;
+				WindowVertices kept;
+				ViableCache kept_viables;
+				size_t remade = 0;
+
+				auto const t0 = std::chrono::steady_clock::now();
+
+				for (unsigned i = 0; i != frames; ++i)
+				{
+					scenario(i, f);
+
+					WindowVertices fresh;
+					WindowVertices & v = keep ? kept : fresh;
+					ViableCache fresh_viables;
+
+					renderWindow(view, graph, at(f.location, graph), f.camera, joint,
+						colors, f.location, selection, style, playerDrawer,
+						keep ? kept_viables : fresh_viables, v);
+
+					remade += v.remade;
+					v.remade = 0;
+				}
+
+				double const us = std::chrono::duration<double, std::micro>(
+					std::chrono::steady_clock::now() - t0).count() / frames;
+
+				cout << "  " << (keep ? "kept " : "fresh") << std::setw(10) << std::fixed
+					<< std::setprecision(1) << us << " us/frame, "
+					<< std::setprecision(2) << double(remade) / frames << " parts remade/frame\n";
+			};
+
+		cout << name << ":\n";
+		measure(false);
+		measure(true);
+	}
+}
+
+int main(int const argc, char const * const * const argv)
+{
+	try
+	{
+		optional<Config> const config = config_from_args(argc, argv);
+		if (!config) return 0;
+
+		Graph const graph = loadGraph(config->db);
+
+		if (config->transition >= graph.num_sequences()) error("no such transition");
+
+		SeqNum const seq{config->transition};
+		OrientedPath const selection{nonreversed(seq) * PositionReorientation{}};
+
+		Frame start{Location{first_segment(seq), 0} * PositionReorientation{}, Camera{}};
+		start.camera.setOffset(center(at(start.location, graph)));
+
+		unsigned const frames = config->frames;
+
+		run("idle (nothing changes)", graph, selection, start,
+			[](unsigned, Frame &){}, frames);
+
+		run("orbit (camera rotates)", graph, selection, start,
+			[](unsigned, Frame & f){ f.camera.rotateHorizontal(0.01); }, frames);
+
+		run("browse (location moves along the transition)", graph, selection, start,
+			[&](unsigned const i, Frame & f)
+			{
+				double const pos = (i % 120) / 120. * num_segments(graph[seq]);
+				SegmentNum const seg{uint_fast8_t(std::min(pos, num_segments(graph[seq]) - 1.))};
+				f.location = Location{seq * seg, pos - seg.index} * PositionReorientation{};
+				f.camera.setOffset(center(at(f.location, graph)));
+			}, frames);
+	}
+	catch (std::exception const & e)
+	{
+		std::cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
+}
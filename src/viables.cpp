@@ -5,11 +5,10 @@ namespace GrappleMap {
 
 namespace
 {
-	void extend(
+	size_t explore(
 		Graph const & graph,
 		PlayerJoint const j,
-		Camera const * const camera,
-		vector<Viable> & viables,
+		ViableTree & tree,
 		unsigned const depth,
 		Reoriented<PositionInSequence> pp,
 		bool const node_done)
@@ -22,61 +21,97 @@ namespace
 
 		V3 const startv = at(via.sequence * via.origin, j, graph);
 
+		vector<V3> ahead, behind;
+
 		V3 lastv = startv;
-		optional<V2> lastxy;
 		unsigned lastd = depth;
 
-		auto progress = [&](V3 const v)
-			{
-				if (distanceSquared(v, lastv) < 0.003) return false;
-
-				if (camera)
-				{
-					if (!lastxy) lastxy = world2xy(*camera, lastv);
-
-					V2 const xy = world2xy(*camera, v);
-					if (distanceSquared(xy, *lastxy) < 0.0001) return false;
-					lastxy = xy;
-				}
-
-				lastv = v;
-
-				return true;
-			};
-
 		for (; via.end.index != sequ.positions.size(); ++via.end)
 		{
-			if (!progress(apply(via.sequence.reorientation, sequ[via.end], j)))
-				break;
+			V3 const v = apply(via.sequence.reorientation, sequ[via.end], j);
+			if (distanceSquared(v, lastv) < 0.003) break;
+			lastv = v;
 			if (++lastd == 7) break;
+			ahead.push_back(v);
 		}
 
 		lastv = startv;
-		lastxy = boost::none;
 		lastd = depth;
 
 		for (; via.begin != PosNum{0}; --via.begin)
 		{
-			if (!progress(apply(via.sequence.reorientation, sequ.positions[via.begin.index - 1], j)))
-				break;
+			V3 const v = apply(via.sequence.reorientation, sequ.positions[via.begin.index - 1], j);
+			if (distanceSquared(v, lastv) < 0.003) break;
+			lastv = v;
 			if (++lastd == 7) break;
+			behind.push_back(v);
 		}
 
-		viables.push_back(via);
+		size_t const b = tree.branches.size();
+
+		{
+			ViableTree::Branch branch{via, {behind.rbegin(), behind.rend()}, {}, {}};
+			branch.points.push_back(startv);
+			branch.points.insert(branch.points.end(), ahead.begin(), ahead.end());
+			tree.branches.push_back(std::move(branch));
+		}
 
-		auto further = [&](Reoriented<NodeNum> const & n, unsigned const depth)
+		auto further = [&](Reoriented<NodeNum> const & n, unsigned const depth, vector<size_t> ViableTree::Branch::* const children)
 			{
 				for (Reoriented<Reversible<SeqNum>> const & seq : inout_sequences(n, graph))
 					if (**seq != *via.sequence)
-						extend(graph, j, camera, viables,
+					{
+						size_t const c = explore(graph, j, tree,
 							depth, first_pos_in(seq, graph), true);
+						(tree.branches[b].*children).push_back(c);
+					}
 			};
 
 		if (via.end == end(sequ) && (via.end != next(pp->position) || !node_done))
-			further(to(via.sequence, graph), via.depth(*prev(via.end)));
+			further(to(via.sequence, graph), via.depth(*prev(via.end)), &ViableTree::Branch::at_end);
 
 		if (via.begin == PosNum{0} && (pp->position != PosNum{0} || !node_done))
-			further(from(via.sequence, graph), via.depth(via.begin));
+			further(from(via.sequence, graph), via.depth(via.begin), &ViableTree::Branch::at_begin);
+
+		return b;
+	}
+
+	void prune(ViableTree const & tree, size_t const b, Camera const * const camera, vector<Viable> & out)
+		// Cuts ranges short where the joint stops moving on screen,
+		// which is where determineViables used to stop with a camera.
+	{
+		ViableTree::Branch const & branch = tree.branches[b];
+		Viable via = branch.reach;
+
+		if (camera)
+		{
+			auto const i = [&](PosNum const p) { return p.index - branch.reach.begin.index; };
+
+			vector<V2> xy(branch.points.size());
+			world2xy(*camera, branch.points.data(), branch.points.size(), xy.data());
+
+			for (PosNum p = next(via.origin); p != branch.reach.end; ++p)
+				if (distanceSquared(xy[i(p)], xy[i(p) - 1]) < 0.0001)
+				{
+					via.end = p;
+					break;
+				}
+
+			for (PosNum p = via.origin; p != branch.reach.begin; --p)
+				if (distanceSquared(xy[i(p) - 1], xy[i(p)]) < 0.0001)
+				{
+					via.begin = p;
+					break;
+				}
+		}
+
+		out.push_back(via);
+
+		if (via.end == branch.reach.end)
+			foreach (c : branch.at_end) prune(tree, c, camera, out);
+
+		if (via.begin == branch.reach.begin)
+			foreach (c : branch.at_begin) prune(tree, c, camera, out);
 	}
 }
 
@@ -94,12 +129,57 @@ bool viable(Graph const & graph,
 			world2xy(*camera, at(to(segment), j, graph))) > 0.0001);
 }
 
+ViableTree viableTree
+	( Graph const & graph, Reoriented<PositionInSequence> const from
+	, PlayerJoint const j)
+{
+	ViableTree r;
+	explore(graph, j, r, 0, from, false);
+	return r;
+}
+
+vector<Viable> determineViables(ViableTree const & tree, Camera const * const camera)
+{
+	vector<Viable> r;
+	prune(tree, 0, camera, r);
+	return r;
+}
+
 vector<Viable> determineViables
 	( Graph const & graph, Reoriented<PositionInSequence> const from
 	, PlayerJoint const j, Camera const * const camera)
 {
-	vector<Viable> r;
-	extend(graph, j, camera, r, 0, from, false);
+	return determineViables(viableTree(graph, from, j), camera);
+}
+
+CandidateEnds candidateEnds(
+	Graph const & graph, Reoriented<SegmentInSequence> const & current,
+	OrientedPath const * const selection)
+{
+	CandidateEnds r;
+
+	foreach (candidate : make_vector(current) + neighbours(current, graph, true))
+		if (!selection || elem(candidate->sequence, *selection))
+			foreach (j : playerJoints)
+				if (viable(graph, candidate, j, nullptr))
+					r.candidates[j].push_back(CandidateEnds::Candidate
+						{ candidate
+						, at(from(candidate), j, graph)
+						, at(to(candidate), j, graph) });
+
+	return r;
+}
+
+PerPlayerJoint<vector<Reoriented<SegmentInSequence>>>
+	closeCandidates(CandidateEnds const & ends, Camera const * const camera)
+{
+	PerPlayerJoint<vector<Reoriented<SegmentInSequence>>> r;
+
+	foreach (j : playerJoints)
+		foreach (c : ends.candidates[j])
+			if (!camera || distanceSquared(world2xy(*camera, c.from), world2xy(*camera, c.to)) > 0.0001)
+				r[j].push_back(c.segment);
+
 	return r;
 }
 
@@ -108,15 +188,65 @@ PerPlayerJoint<vector<Reoriented<SegmentInSequence>>>
 		Graph const & graph, Reoriented<SegmentInSequence> const & current,
 		Camera const * const camera, OrientedPath const * const selection)
 {
-	PerPlayerJoint<vector<Reoriented<SegmentInSequence>>> r;
+	return closeCandidates(candidateEnds(graph, current, selection), camera);
+}
 
-	foreach (candidate : make_vector(current) + neighbours(current, graph, true))
-		if (!selection || elem(candidate->sequence, *selection))
-			foreach (j : playerJoints)
-				if (viable(graph, candidate, j, camera))
-					r[j].push_back(candidate);
+CameraKey quantized(Camera const & camera)
+{
+	CameraKey k;
+	for (unsigned i = 0; i != k.size(); ++i)
+		k[i] = int32_t(std::lround(camera.full()[i] * 4096));
+	return k;
+}
 
-	return r;
+vector<Viable> const & ViableCache::viables(
+	Graph const & graph, Reoriented<PositionInSequence> const & from,
+	PlayerJoint const j, Camera const & camera)
+{
+	auto const key = std::make_tuple(graph.revision(), from, j);
+
+	if (!viables_.key || *viables_.key != key)
+	{
+		viables_.key = key;
+		viables_.independent = viableTree(graph, from, j);
+		viables_.camera = none;
+	}
+
+	CameraKey const c = quantized(camera);
+
+	if (!viables_.camera || *viables_.camera != c)
+	{
+		viables_.camera = c;
+		viables_.result = determineViables(viables_.independent, &camera);
+	}
+
+	return viables_.result;
+}
+
+PerPlayerJoint<vector<Reoriented<SegmentInSequence>>> const &
+	ViableCache::candidates(
+		Graph const & graph, Reoriented<SegmentInSequence> const & current,
+		Camera const & camera, OrientedPath const * const selection)
+{
+	auto const key = std::make_tuple(graph.revision(), current,
+		selection ? optional<OrientedPath>(*selection) : optional<OrientedPath>());
+
+	if (!candidates_.key || *candidates_.key != key)
+	{
+		candidates_.key = key;
+		candidates_.independent = candidateEnds(graph, current, selection);
+		candidates_.camera = none;
+	}
+
+	CameraKey const c = quantized(camera);
+
+	if (!candidates_.camera || *candidates_.camera != c)
+	{
+		candidates_.camera = c;
+		candidates_.result = closeCandidates(candidates_.independent, &camera);
+	}
+
+	return candidates_.result;
 }
 
 }
@@ -2,6 +2,7 @@
 #define GRAPPLEMAP_VIABLES_HPP
 
 #include "paths.hpp"
+#include <array>
 #include <map>
 
 namespace GrappleMap
@@ -35,6 +36,85 @@ namespace GrappleMap
 		closeCandidates(
 			Graph const &, Reoriented<SegmentInSequence> const &,
 			Camera const *, OrientedPath const *);
+
+	using CameraKey = std::array<int32_t, 16>;
+
+	CameraKey quantized(Camera const &);
+		// The camera's full matrix, in steps small enough that on-screen
+		// distances move by well under the tolerances used above.
+
+	struct ViableTree
+		// What determineViables finds without a camera. With a camera, it
+		// finds a subtree of this, with some ranges cut short.
+	{
+		struct Branch
+		{
+			Viable reach;
+			vector<V3> points; // the joint's position at reach.begin, ..., reach.end - 1
+			vector<size_t> at_end, at_begin; // branches continuing from there
+		};
+
+		vector<Branch> branches; // depth first, starting at the origin
+	};
+
+	ViableTree viableTree(Graph const &, Reoriented<PositionInSequence>, PlayerJoint);
+
+	vector<Viable> determineViables(ViableTree const &, Camera const *);
+
+	struct CandidateEnds
+		// What closeCandidates finds without a camera, for each joint with
+		// the joint's positions at either end of the segment.
+	{
+		struct Candidate
+		{
+			Reoriented<SegmentInSequence> segment;
+			V3 from, to;
+		};
+
+		PerPlayerJoint<vector<Candidate>> candidates;
+	};
+
+	CandidateEnds candidateEnds(
+		Graph const &, Reoriented<SegmentInSequence> const &,
+		OrientedPath const *);
+
+	PerPlayerJoint<vector<Reoriented<SegmentInSequence>>>
+		closeCandidates(CandidateEnds const &, Camera const *);
+
+	class ViableCache
+		// Memoizes determineViables and closeCandidates for the editors, which
+		// ask for them every frame, mostly with the same arguments. Results are
+		// keyed on the graph's revision, the location, the joint or selection,
+		// and the quantized camera. When only the camera has changed, the
+		// camera-independent part (see ViableTree and CandidateEnds) is kept,
+		// and only the pruning by on-screen distance is redone.
+	{
+		template<typename Key, typename Independent, typename Result>
+		struct Entry
+		{
+			optional<Key> key;
+			Independent independent;
+			optional<CameraKey> camera;
+			Result result;
+		};
+
+		Entry<std::tuple<size_t, Reoriented<PositionInSequence>, PlayerJoint>,
+			ViableTree, vector<Viable>> viables_;
+
+		Entry<std::tuple<size_t, Reoriented<SegmentInSequence>, optional<OrientedPath>>,
+			CandidateEnds, PerPlayerJoint<vector<Reoriented<SegmentInSequence>>>> candidates_;
+
+	public:
+
+		vector<Viable> const & viables(
+			Graph const &, Reoriented<PositionInSequence> const &,
+			PlayerJoint, Camera const &);
+
+		PerPlayerJoint<vector<Reoriented<SegmentInSequence>>> const &
+			candidates(
+				Graph const &, Reoriented<SegmentInSequence> const &,
+				Camera const &, OrientedPath const *);
+	};
 }
 
 #endif
@@ -3,10 +3,129 @@
 #include "persistence.hpp"
 #include "js_conversions.hpp"
 
+namespace
+{
+	using namespace GrappleMap;
+
+	optional<DatabaseHead> streamed;
+		// set by loadDBHead, for pages that fetch the database in chunks
+		// instead of having it preloaded
+
+	Graph const & db()
+	{
+		if (streamed) return streamed->graph;
+
+		static Graph const g = loadBinaryGraph("GrappleMap.bin");
+		return g;
+	}
+
+	vector<vector<float>> frame_cache, stand_in_cache, position_cache;
+		// by SeqNum and NodeNum, filled on demand, or as chunks arrive if streamed
+
+	void append_floats(Position const & p, vector<float> & out)
+		// players, joints, xyz (see position_from_floats in gm.js)
+	{
+		foreach (n : playerNums())
+		foreach (j : joints)
+		{
+			V3 const v = p[n][j];
+			out.push_back(v.x);
+			out.push_back(v.y);
+			out.push_back(v.z);
+		}
+	}
+
+	emscripten::val float_view(vector<float> const & v)
+		// A Float32Array directly over the wasm heap. The vectors handed to
+		// this are never freed or resized, so the view stays valid.
+	{
+		return emscripten::val(emscripten::typed_memory_view(v.size(), v.data()));
+	}
+
+	void init_caches()
+	{
+		frame_cache.resize(db().num_sequences());
+		stand_in_cache.resize(db().num_sequences());
+		position_cache.resize(db().num_nodes());
+	}
+}
+
 EMSCRIPTEN_BINDINGS(GrappleMap_db)
 {
 	emscripten::function("loadDB", +[]
 	{
-		return to_elaborate_jsval(GrappleMap::loadGraph("GrappleMap.txt"), false);
+		init_caches();
+
+		return to_elaborate_jsval(db(), false);
+			// metadata only; frames and positions are fetched with
+			// framesOf and positionOf when needed
+	});
+
+	emscripten::function("loadDBHead", +[](std::string const & bytes)
+	{
+		streamed = loadDatabaseHead(bytes.data(), bytes.data() + bytes.size());
+		init_caches();
+
+		auto r = to_elaborate_jsval(db(), false);
+
+		auto transitions = r["transitions"];
+		foreach (s : seqnums(db()))
+		{
+			auto t = transitions[s.index];
+			t.set("frame_count", streamed->frame_count[s.index]);
+			t.set("chunk", streamed->chunk[s.index]);
+		}
+
+		r.set("chunk_count", streamed->chunk_count);
+
+		return r;
+	});
+
+	emscripten::function("addChunk", +[](std::string const & bytes)
+	{
+		// returns the ids of the transitions whose frames are now available
+
+		vector<uint32_t> ids;
+
+		foreach (x : loadDatabaseChunk(bytes.data(), bytes.data() + bytes.size(), db().num_sequences()))
+		{
+			vector<float> & v = frame_cache[x.first.index];
+			if (!v.empty()) continue;
+
+			foreach (p : x.second) append_floats(p, v);
+			ids.push_back(x.first.index);
+		}
+
+		return tojsval(ids);
+	});
+
+	emscripten::function("framesOf", +[](uint32_t const s)
+	{
+		// If streamed and the chunk has not arrived yet, just the end frames.
+
+		if (s >= frame_cache.size()) return emscripten::val::null();
+
+		vector<float> & v = frame_cache[s];
+
+		if (!v.empty()) return float_view(v);
+
+		vector<float> & w = streamed ? stand_in_cache[s] : v;
+
+		if (w.empty())
+			foreach (p : db()[SeqNum{s}].positions)
+				append_floats(p, w);
+
+		return float_view(w);
+	});
+
+	emscripten::function("positionOf", +[](uint32_t const n)
+	{
+		if (n >= position_cache.size()) return emscripten::val::null();
+
+		vector<float> & v = position_cache[n];
+
+		if (v.empty()) append_floats(db()[NodeNum{uint16_t(n)}].position, v);
+
+		return float_view(v);
 	});
 }
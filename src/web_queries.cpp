@@ -0,0 +1,294 @@
+#include <emscripten/emscripten.h>
+#include <emscripten/threading.h>
+#include <emscripten/bind.h>
+#include "persistence.hpp"
+#include "js_conversions.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <sstream>
+#include <cstring>
+
+// The graph queries of libgrapplemap-queries.js. The graph lives on a pthread
+// of its own: the bindings below only enqueue a job and return, and each job's
+// JSON result is handed back to the main thread's Module.queries.settle (see
+// queries.js), which resolves the corresponding promise.
+
+namespace
+{
+	using namespace GrappleMap;
+
+	struct Job
+	{
+		int id;
+		function<void(std::ostream &)> run;
+			// writes the JSON result, or throws
+	};
+
+	// owned by the query thread:
+
+	optional<Graph> graph;
+	vector<size_t> frame_count; // by SeqNum
+	optional<QueryEngine> query_engine;
+
+	Graph const & db()
+	{
+		if (!graph) error("no database opened");
+		return *graph;
+	}
+
+	// shared:
+
+	std::mutex mutex;
+	std::condition_variable job_posted;
+	std::deque<Job> jobs;
+
+	template<typename R>
+	void json_indices(R const & r, std::ostream & o)
+	{
+		o << '[';
+		bool first = true;
+		foreach (x : r)
+		{
+			if (!first) o << ',';
+			first = false;
+			o << x.index;
+		}
+		o << ']';
+	}
+
+	void settle(int const id, char * const json)
+		// runs on the main thread
+	{
+		EM_ASM({ Module.queries.settle($0, UTF8ToString($1)); }, id, json);
+		std::free(json);
+	}
+
+	void serve()
+	{
+		for (;;)
+		{
+			Job job;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				job_posted.wait(lock, []{ return !jobs.empty(); });
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			std::ostringstream o;
+
+			try
+			{
+				std::ostringstream r;
+				job.run(r);
+				o << "{\"result\":" << r.str() << '}';
+			}
+			catch (std::exception const & e)
+			{
+				o << "{\"error\":";
+				json_string(e.what(), o);
+				o << '}';
+			}
+
+			emscripten_async_run_in_main_runtime_thread(
+				EM_FUNC_SIG_VII, reinterpret_cast<void *>(&settle), job.id, strdup(o.str().c_str()));
+		}
+	}
+
+	void post(int const id, function<void(std::ostream &)> run)
+	{
+		static std::once_flag started;
+		std::call_once(started, []{ std::thread(serve).detach(); });
+			// from PTHREAD_POOL_SIZE, so no need to wait for a worker to be spawned
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(Job{id, std::move(run)});
+		}
+
+		job_posted.notify_one();
+	}
+
+	NodeNum step_to(Step const s, Graph const & g)
+	{
+		return *(s.reverse ? g[*s].from : g[*s].to);
+	}
+
+	NodeNum step_from(Step const s, Graph const & g)
+	{
+		return step_to(reverse(s), g);
+	}
+
+	vector<NodeNum> neighbours(NodeNum const n, Graph const & g)
+	{
+		vector<NodeNum> r;
+		foreach (s : g[n].out) r.push_back(step_to(s, g));
+		foreach (s : g[n].in) r.push_back(step_from(s, g));
+		return r;
+	}
+
+	void open(Graph && g, vector<size_t> counts, std::ostream & o)
+	{
+		graph = std::move(g);
+		frame_count = std::move(counts);
+		query_engine.emplace(*graph);
+		o << "{\"nodes\":" << graph->num_nodes() << ",\"transitions\":" << graph->num_sequences() << '}';
+	}
+
+	void search(TagQuery const & q, vector<string> const & substrs, std::ostream & o)
+	{
+		if (!query_engine) error("no database opened");
+		tojson((*query_engine)(q, substrs), o);
+	}
+
+	void random_path(size_t const min_frames, unsigned const seed, std::ostream & o)
+		// like random_path in gm.js
+	{
+		Graph const & g = db();
+
+		bool any_out = false;
+		foreach (n : nodenums(g)) if (!g[n].out.empty()) any_out = true;
+		if (!any_out) error("no transitions to make a path of");
+
+		std::mt19937 rng(seed);
+		auto const random = [&](size_t const n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+
+		vector<Step> steps;
+		size_t frames = 0;
+		NodeNum node{uint16_t(random(g.num_nodes()))};
+
+		auto const restart = [&]
+			{
+				steps.clear();
+				frames = 0;
+				node = NodeNum{uint16_t(random(g.num_nodes()))};
+			};
+
+		while (frames < min_frames)
+		{
+			auto const & choices = g[node].out;
+
+			if (choices.empty()) { restart(); continue; }
+
+			Step const step = choices[random(choices.size())];
+
+			if (steps.empty() || *steps.back() != *step)
+			{
+				steps.push_back(step);
+				frames += frame_count[step->index];
+				node = step_to(step, g);
+			}
+			else if (choices.size() == 1) restart();
+		}
+
+		o << '[';
+		foreach (s : steps)
+		{
+			if (&s != &steps.front()) o << ',';
+			o << "{\"transition\":" << s->index << ",\"reverse\":" << (s.reverse ? "true" : "false") << '}';
+		}
+		o << ']';
+	}
+
+	void grow(NodeNum const start, set<NodeNum> const & within, std::ostream & o)
+		// like grow in gm.js, with within.count as the predicate
+	{
+		Graph const & g = db();
+
+		if (start.index >= g.num_nodes()) error("no such node");
+
+		vector<NodeNum> yes, queue{start};
+		set<NodeNum> seen{start};
+
+		if (within.count(start)) yes.push_back(start);
+
+		while (!queue.empty())
+		{
+			NodeNum const n = queue.back();
+			queue.pop_back();
+
+			foreach (m : neighbours(n, g))
+				if (seen.insert(m).second && within.count(m))
+				{
+					yes.push_back(m);
+					queue.push_back(m);
+				}
+		}
+
+		json_indices(yes, o);
+	}
+
+	set<NodeNum> node_set(emscripten::val const & a)
+	{
+		set<NodeNum> r;
+		foreach (i : emscripten::vecFromJSArray<unsigned>(a))
+			r.insert(NodeNum{uint16_t(i)});
+		return r;
+	}
+}
+
+EMSCRIPTEN_BINDINGS(GrappleMap_queries)
+{
+	// Each of these takes the id that the result is settled with.
+	// Arguments are converted here, on the main thread, because
+	// vals cannot be used on the query thread.
+
+	emscripten::function("queryOpen", +[](int const id, std::string const & bytes)
+	{
+		post(id, [bytes](std::ostream & o)
+			{
+				Graph g = loadBinaryGraph(bytes.data(), bytes.data() + bytes.size());
+				vector<size_t> counts;
+				foreach (s : seqnums(g)) counts.push_back(g[s].positions.size());
+				open(std::move(g), std::move(counts), o);
+			});
+	});
+
+	emscripten::function("queryOpenHead", +[](int const id, std::string const & bytes)
+	{
+		post(id, [bytes](std::ostream & o)
+			{
+				DatabaseHead h = loadDatabaseHead(bytes.data(), bytes.data() + bytes.size());
+				open(std::move(h.graph), std::move(h.frame_count), o);
+			});
+	});
+
+	emscripten::function("querySearch", +[](int const id, emscripten::val const & tags, emscripten::val const & substrs)
+	{
+		TagQuery const q = tag_query_fromjsval(tags);
+		vector<string> const ss = emscripten::vecFromJSArray<std::string>(substrs);
+
+		post(id, [q, ss](std::ostream & o){ search(q, ss, o); });
+	});
+
+	emscripten::function("queryPath", +[](int const id, unsigned const min_frames, unsigned const seed)
+	{
+		post(id, [=](std::ostream & o){ random_path(min_frames, seed, o); });
+	});
+
+	emscripten::function("queryNeighbourhood", +[](int const id, emscripten::val const & nodes, unsigned const depth)
+	{
+		set<NodeNum> const ns = node_set(nodes);
+
+		post(id, [ns, depth](std::ostream & o)
+			{
+				Graph const & g = db();
+
+				foreach (n : ns)
+					if (n.index >= g.num_nodes()) error("no such node");
+
+				json_indices(nodes_around(g, ns, depth), o);
+			});
+	});
+
+	emscripten::function("queryGrow", +[](int const id, unsigned const start, emscripten::val const & within)
+	{
+		set<NodeNum> const w = node_set(within);
+
+		post(id, [start, w](std::ostream & o){ grow(NodeNum{uint16_t(start)}, w, o); });
+	});
+}